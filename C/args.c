@@ -1,5 +1,9 @@
 #include "args.h"
 #include "const.h"
+#include "estimate.h"
+#include "progress.h"
+#include "serve.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,9 +24,26 @@ static bool ensure_capacity(char ***array, int *capacity, int count)
     return true;
 }
 
+// accepts only a whole, non-negative decimal number
+static bool parse_count(const char *opt, const char *value, int *out)
+{
+    char *end = NULL;
+    long n = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < 0 || n > INT_MAX)
+    {
+        fprintf(stderr, "Error: invalid value '%s' for %s\n", value, opt);
+        return false;
+    }
+    *out = (int)n;
+    return true;
+}
+
 void args_init(args_t *args)
 {
     memset(args, 0, sizeof(args_t));
+    args->estimate_samples = ESTIMATE_DEFAULT_SAMPLES;
+    args->estimate_depth = ESTIMATE_DEFAULT_DEPTH;
+    args->rescan = SERVE_DEFAULT_RESCAN;
 }
 
 void args_free(args_t *args)
@@ -57,6 +78,9 @@ static bool handle_short_option(char opt,
         case 'a':
             args->apparent_size = true;
             return true;
+        case 'L':
+            args->dereference = true;
+            return true;
         case 'v':
             args->verbose = true;
             args->quiet = false;
@@ -100,7 +124,14 @@ bool args_parse(args_t *args, int argc, char **argv)
 
     args->quiet = true;
 
-    for (int i = 1; i < argc; i++)
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "serve") == 0)
+    {
+        args->serve = true;
+        first = 2;
+    }
+
+    for (int i = first; i < argc; i++)
     {
         const char *arg = argv[i];
 
@@ -129,6 +160,163 @@ bool args_parse(args_t *args, int argc, char **argv)
             {
                 args->apparent_size = true;
             }
+            else if (strncmp(arg, "--files0-from=", 14) == 0)
+            {
+                args->files0_from = (char *)(arg + 14);
+            }
+            else if (strcmp(arg, "--dereference") == 0)
+            {
+                args->dereference = true;
+            }
+            else if (strcmp(arg, "--by-ext") == 0)
+            {
+                args->by_ext = true;
+            }
+            else if (strcmp(arg, "--estimate") == 0)
+            {
+                args->estimate = true;
+            }
+            else if (strncmp(arg, "--estimate=", 11) == 0)
+            {
+                args->estimate = true;
+                if (!parse_count(
+                      "--estimate", arg + 11, &args->estimate_samples))
+                {
+                    return false;
+                }
+                if (args->estimate_samples == 0)
+                {
+                    fprintf(stderr, "Error: --estimate needs a sample\n");
+                    return false;
+                }
+            }
+            else if (strncmp(arg, "--estimate-seed=", 16) == 0)
+            {
+                const char *value = arg + 16;
+                char *end = NULL;
+                args->estimate = true;
+                args->estimate_seed = strtoull(value, &end, 10);
+                args->estimate_seeded = true;
+                if (*value < '0' || *value > '9' || *end != '\0')
+                {
+                    fprintf(stderr,
+                            "Error: invalid value '%s' for --estimate-seed\n",
+                            value);
+                    return false;
+                }
+            }
+            else if (strncmp(arg, "--estimate-depth=", 17) == 0)
+            {
+                args->estimate = true;
+                if (!parse_count(
+                      "--estimate-depth", arg + 17, &args->estimate_depth))
+                {
+                    return false;
+                }
+            }
+            else if (strcmp(arg, "--sort=size") == 0)
+            {
+                args->sort = SORT_SIZE;
+            }
+            else if (strcmp(arg, "--sort=name") == 0)
+            {
+                args->sort = SORT_NAME;
+            }
+            else if (strncmp(arg, "--sort=", 7) == 0)
+            {
+                fprintf(stderr,
+                        "Error: invalid value '%s' for --sort "
+                        "(expected size or name)\n",
+                        arg + 7);
+                return false;
+            }
+            else if (strncmp(arg, "--checkpoint=", 13) == 0)
+            {
+                args->checkpoint = (char *)(arg + 13);
+            }
+            else if (strcmp(arg, "--resume") == 0)
+            {
+                args->resume = true;
+            }
+            else if (strncmp(arg, "--time-limit=", 13) == 0)
+            {
+                if (!parse_count(
+                      "--time-limit", arg + 13, &args->time_limit))
+                {
+                    return false;
+                }
+            }
+            else if (strncmp(arg, "--affinity=", 11) == 0)
+            {
+                const char *mode = arg + 11;
+                if (strcmp(mode, "compact") == 0)
+                {
+                    args->affinity = AFFINITY_COMPACT;
+                }
+                else if (strcmp(mode, "spread") == 0)
+                {
+                    args->affinity = AFFINITY_SPREAD;
+                }
+                else if (strcmp(mode, "none") == 0)
+                {
+                    args->affinity = AFFINITY_NONE;
+                }
+                else
+                {
+                    fprintf(stderr,
+                            "Error: invalid value '%s' for --affinity "
+                            "(expected compact, spread or none)\n",
+                            mode);
+                    return false;
+                }
+            }
+            else if (strncmp(arg, "--max-iops=", 11) == 0)
+            {
+                if (!parse_count("--max-iops", arg + 11, &args->max_iops))
+                {
+                    return false;
+                }
+            }
+            else if (strncmp(arg, "--latency-target=", 17) == 0)
+            {
+                if (!parse_count("--latency-target",
+                                 arg + 17,
+                                 &args->latency_target_us))
+                {
+                    return false;
+                }
+            }
+            else if (strcmp(arg, "--progress") == 0)
+            {
+                args->progress = PROGRESS_DEFAULT_INTERVAL;
+            }
+            else if (strncmp(arg, "--progress=", 11) == 0)
+            {
+                if (!parse_count("--progress", arg + 11, &args->progress))
+                {
+                    return false;
+                }
+                if (args->progress == 0)
+                {
+                    fprintf(stderr, "Error: --progress needs an interval\n");
+                    return false;
+                }
+            }
+            else if (strncmp(arg, "--shm=", 6) == 0)
+            {
+                args->shm = (char *)(arg + 6);
+            }
+            else if (strncmp(arg, "--socket=", 9) == 0)
+            {
+                args->socket = (char *)(arg + 9);
+            }
+            else if (strncmp(arg, "--rescan=", 9) == 0)
+            {
+                if (!parse_count("--rescan", arg + 9, &args->rescan))
+                {
+                    return false;
+                }
+            }
             else if (strcmp(arg, "--verbose") == 0)
             {
                 args->verbose = true;
@@ -178,7 +366,88 @@ bool args_parse(args_t *args, int argc, char **argv)
         return true;
     }
 
-    if (args->path_count == 0)
+    if (args->resume && !args->checkpoint)
+    {
+        fprintf(stderr, "Error: --resume requires --checkpoint=FILE\n");
+        return false;
+    }
+
+    if (args->sort != SORT_NONE && !args->verbose)
+    {
+        fprintf(stderr, "Error: --sort orders the -v output; add -v\n");
+        return false;
+    }
+
+    // random probes through followed links could circle forever
+    if (args->estimate && args->dereference)
+    {
+        fprintf(stderr, "Error: --estimate can't be combined with -L\n");
+        return false;
+    }
+
+    // sampling walks no tree, so there is nothing to count
+    if (args->estimate && (args->progress > 0 || args->shm))
+    {
+        fprintf(stderr,
+                "Error: --estimate can't be combined with --progress "
+                "or --shm\n");
+        return false;
+    }
+
+    // sampled files are only seen as weighted totals, and a probe has no
+    // frontier to save
+    if (args->estimate && (args->verbose || args->by_ext ||
+                           args->sort != SORT_NONE || args->checkpoint ||
+                           args->time_limit > 0))
+    {
+        fprintf(stderr,
+                "Error: --estimate can't be combined with -v, --by-ext, "
+                "--sort, --checkpoint or --time-limit\n");
+        return false;
+    }
+
+    // the checkpoint's pending directories are the paths
+    if (args->resume && args->path_count > 0)
+    {
+        fprintf(stderr,
+                "Error: --resume continues the checkpoint's paths; "
+                "drop the path operands\n");
+        return false;
+    }
+
+    if (args->files0_from && args->path_count > 0)
+    {
+        fprintf(stderr,
+                "Error: paths can't be combined with --files0-from\n");
+        return false;
+    }
+
+    // the list is read once and never held in full
+    if (args->files0_from && (args->serve || args->estimate ||
+                              args->checkpoint || args->time_limit > 0))
+    {
+        fprintf(stderr,
+                "Error: --files0-from can't be combined with serve, "
+                "--estimate, --checkpoint or --time-limit\n");
+        return false;
+    }
+
+    if (args->serve && !args->socket)
+    {
+        fprintf(stderr, "Error: serve requires --socket=PATH\n");
+        return false;
+    }
+
+    if (args->serve &&
+        (args->estimate || args->checkpoint || args->time_limit > 0))
+    {
+        fprintf(stderr,
+                "Error: serve does not take --estimate, --checkpoint "
+                "or --time-limit\n");
+        return false;
+    }
+
+    if (args->path_count == 0 && !args->files0_from)
     {
         args->paths[0] = ".";
         args->path_count = 1;
@@ -1,15 +1,38 @@
 #ifndef UDU_ARGS_H
 #define UDU_ARGS_H
 
+#include "platform.h"
+#include "record.h"
 #include <stdbool.h>
 
 typedef struct
 {
     char **paths;
     int path_count;
+    char *files0_from; // "-" for stdin
     char **excludes;
     int exclude_count;
     bool apparent_size;
+    bool dereference;
+    bool by_ext;
+    sort_key_t sort;
+    char *checkpoint;
+    bool resume;
+    int time_limit;
+    affinity_t affinity;
+    int max_iops;          // 0 = unlimited
+    int latency_target_us; // 0 = off
+    int progress;          // seconds between progress lines, 0 = off
+    char *shm;             // shared memory name for live counters
+    bool serve;
+    char *socket;
+    int rescan;
+    bool index; // keep per-directory totals (set by serve)
+    bool estimate;
+    int estimate_samples;
+    int estimate_depth;
+    uint64_t estimate_seed;
+    bool estimate_seeded;
     bool verbose;
     bool quiet;
     bool help;
@@ -0,0 +1,175 @@
+#include "checkpoint.h"
+#include "platform.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC "udu-checkpoint 2"
+
+/*
+ * Layout: five text header lines followed by the exclude patterns and then
+ * the pending paths, each terminated by NUL so any byte a filename may
+ * contain survives. The options that change what a walk counts are kept
+ * so a resume can refuse to mix them.
+ */
+bool checkpoint_save(const char *file, const checkpoint_t *cp)
+{
+    size_t len = strlen(file);
+    char *tmp = malloc(len + 5);
+    if (!tmp) return false;
+    memcpy(tmp, file, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+    {
+        free(tmp);
+        return false;
+    }
+
+    bool ok = fprintf(fp,
+                      CHECKPOINT_MAGIC "\napparent %d\ndereference %d\n"
+                                       "excludes %d\ntotals %" PRIu64
+                                       " %" PRIu64 " %" PRIu64 "\n",
+                      cp->apparent_size ? 1 : 0,
+                      cp->dereference ? 1 : 0,
+                      cp->exclude_count,
+                      cp->total_size,
+                      cp->file_count,
+                      cp->dir_count) > 0;
+
+    for (int i = 0; ok && i < cp->exclude_count; i++)
+    {
+        size_t n = strlen(cp->excludes[i]) + 1;
+        ok = fwrite(cp->excludes[i], 1, n, fp) == n;
+    }
+    for (size_t i = 0; ok && i < cp->pending_count; i++)
+    {
+        size_t n = strlen(cp->pending[i]) + 1;
+        ok = fwrite(cp->pending[i], 1, n, fp) == n;
+    }
+
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && platform_replace_file(tmp, file);
+    if (!ok) remove(tmp);
+    free(tmp);
+    return ok;
+}
+
+static char *read_all(const char *file, size_t *size)
+{
+    FILE *fp = fopen(file, "rb");
+    if (!fp) return NULL;
+
+    size_t cap = 64 * 1024;
+    size_t len = 0;
+    char *buf = malloc(cap);
+    while (buf)
+    {
+        len += fread(buf + len, 1, cap - len, fp);
+        if (len < cap) break;
+        char *grown = realloc(buf, cap * 2);
+        if (!grown)
+        {
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        buf = grown;
+        cap *= 2;
+    }
+
+    bool failed = ferror(fp) != 0;
+    fclose(fp);
+    if (failed)
+    {
+        free(buf);
+        return NULL;
+    }
+    *size = len;
+    return buf;
+}
+
+// returns the start of the next line, or NULL if there is none
+static char *next_line(char *p, char *end)
+{
+    char *nl = memchr(p, '\n', (size_t)(end - p));
+    if (!nl) return NULL;
+    *nl = '\0';
+    return nl + 1;
+}
+
+bool checkpoint_load(const char *file, checkpoint_t *cp)
+{
+    memset(cp, 0, sizeof(*cp));
+
+    size_t size = 0;
+    char *buf = read_all(file, &size);
+    if (!buf) return false;
+
+    char *end = buf + size;
+    char *magic = buf;
+    char *apparent = next_line(magic, end);
+    char *deref = apparent ? next_line(apparent, end) : NULL;
+    char *excludes = deref ? next_line(deref, end) : NULL;
+    char *totals = excludes ? next_line(excludes, end) : NULL;
+    char *paths = totals ? next_line(totals, end) : NULL;
+    int apparent_flag = 0;
+    int deref_flag = 0;
+
+    if (!paths || strcmp(magic, CHECKPOINT_MAGIC) != 0 ||
+        sscanf(apparent, "apparent %d", &apparent_flag) != 1 ||
+        sscanf(deref, "dereference %d", &deref_flag) != 1 ||
+        sscanf(excludes, "excludes %d", &cp->exclude_count) != 1 ||
+        cp->exclude_count < 0 ||
+        sscanf(totals,
+               "totals %" SCNu64 " %" SCNu64 " %" SCNu64,
+               &cp->total_size,
+               &cp->file_count,
+               &cp->dir_count) != 3)
+    {
+        free(buf);
+        return false;
+    }
+    cp->apparent_size = apparent_flag != 0;
+    cp->dereference = deref_flag != 0;
+
+    size_t count = 0;
+    for (char *p = paths; p < end; p++)
+    {
+        if (*p == '\0') count++;
+    }
+    size_t patterns = (size_t)cp->exclude_count;
+    if (count < patterns)
+    {
+        free(buf);
+        return false;
+    }
+
+    // one array: the patterns first, then the pending paths
+    char **strings = malloc((count ? count : 1) * sizeof(char *));
+    if (!strings)
+    {
+        free(buf);
+        return false;
+    }
+
+    // an unterminated trailing path means a torn write; drop it
+    char *p = paths;
+    for (size_t i = 0; i < count; p += strlen(p) + 1) strings[i++] = p;
+    cp->excludes = strings;
+    cp->pending = strings + patterns;
+    cp->pending_count = count - patterns;
+
+    cp->storage = buf;
+    return true;
+}
+
+void checkpoint_free(checkpoint_t *cp)
+{
+    // a loaded checkpoint owns the array, which starts with the patterns
+    free(cp->storage ? (void *)cp->excludes : (void *)cp->pending);
+    free(cp->storage);
+    memset(cp, 0, sizeof(*cp));
+}
@@ -0,0 +1,33 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Persisted walk state: totals of every directory read so far plus the
+ * frontier of directories that were not (completely) read yet. Frontier
+ * directories are already included in dir_count by their parents.
+ */
+typedef struct
+{
+    uint64_t total_size;
+    uint64_t file_count;
+    uint64_t dir_count;
+    bool apparent_size;
+    bool dereference;
+    // the walk's --exclude patterns; borrowed when saving, in storage when
+    // loaded
+    char **excludes;
+    int exclude_count;
+    char **pending;
+    size_t pending_count;
+    char *storage; // backs the pending strings
+} checkpoint_t;
+
+bool checkpoint_save(const char *file, const checkpoint_t *cp);
+bool checkpoint_load(const char *file, checkpoint_t *cp);
+void checkpoint_free(checkpoint_t *cp);
+
+#endif
@@ -4,12 +4,45 @@
 
 static const char *USAGE =
   "Usage: udu [option(s)]... [path(s)]...\n"
-  " extremely fast disk usage analyzer with parallel traversal engine.\n\n"
+  "       udu serve --socket=PATH [option(s)]... [path(s)]...\n"
+  " extremely fast disk usage analyzer with parallel traversal engine.\n"
+  " (to scan a directory named serve, write ./serve)\n\n"
 
   " OPTIONS:\n"
   "  -a, --apparent-size    show file sizes instead of disk usage\n"
   "                          (apparent = bytes reported by filesystem,\n"
   "                           disk usage = actual space allocated)\n"
+  "  -L, --dereference      follow symbolic links; a directory reached more\n"
+  "                          than once is counted once\n"
+  "      --files0-from=F    read NUL separated paths from file F (- for\n"
+  "                          stdin) instead of the command line\n"
+  "      --by-ext           show size and file count per file extension\n"
+  "      --sort=KEY         sort -v output by KEY: size, name\n"
+  "      --checkpoint=FILE  periodically save progress to FILE\n"
+  "      --resume           continue the scan saved in --checkpoint FILE;\n"
+  "                          takes no paths and the same -L, --exclude and\n"
+  "                          --apparent-size as the saved scan\n"
+  "      --time-limit=SECS  stop after SECS seconds and report partial\n"
+  "                          totals plus the directories not visited\n"
+  "      --affinity=MODE    pin worker threads: compact (fill one NUMA\n"
+  "                          node first), spread (round-robin nodes),\n"
+  "                          none (default)\n"
+  "      --max-iops=N       issue at most N stat and directory reads per\n"
+  "                          second across all threads, 0 = unlimited\n"
+  "      --latency-target=US adapt the rate so those calls average at\n"
+  "                          most US microseconds (--max-iops caps it)\n"
+  "      --progress[=SECS]  print live totals to stderr every SECS seconds\n"
+  "                          (default 5)\n"
+  "      --shm=NAME         publish live totals in shared memory NAME\n"
+  "                          (e.g. /udu-scan) for monitors to poll\n"
+  "      --estimate[=N]     estimate totals by sampling N random paths\n"
+  "                          below each directory (default 64)\n"
+  "      --estimate-depth=D scan the top D levels exactly before\n"
+  "                          sampling (default 2)\n"
+  "      --estimate-seed=N  seed the sampling, to repeat an earlier run\n"
+  "      --socket=PATH      (serve) answer size queries on Unix socket PATH\n"
+  "      --rescan=SECS      (serve) rescan every SECS seconds, 0 = never\n"
+  "                          (default 600)\n"
   "  -h, --help             display this help and exit\n"
   "  -q, --quiet            display output at program exit (default)\n"
   "  -v, --verbose          display each processed file\n"
@@ -0,0 +1,402 @@
+#include "estimate.h"
+#include "platform.h"
+#include "util.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// z value of the two sided 95% confidence interval
+#define CONFIDENCE_Z 1.96
+#define MAX_PROBE_DEPTH 4096
+// directories per sample a subtree may take to be counted exactly
+#define EXACT_DIRS_PER_SAMPLE 4
+// see estimate_subtree
+#define MIN_EFFECTIVE_SHARE 0.25
+#define MIN_EFFECTIVE_PROBES 30 // where the normal approximation holds
+#define MAX_PROBE_FACTOR 8
+
+typedef struct
+{
+    char **excludes;
+    int exclude_count;
+    bool apparent_size;
+    int samples;
+    int depth;
+    uint64_t seed;
+    // exact part (fully enumerated top levels)
+    uint64_t total_size;
+    uint64_t file_count;
+    uint64_t dir_count;
+    // sampled part, means and variances of the estimators
+    double est_size;
+    double est_files;
+    double est_dirs;
+    double var_size;
+    double var_files;
+    double var_dirs;
+    bool uncertain; // a subtree's probes can't back an interval
+} estimate_context_t;
+
+// one directory read; subdirectory paths are owned by the sample
+typedef struct
+{
+    uint64_t size;
+    uint64_t files;
+    char **subdirs;
+    size_t subdir_count;
+    size_t subdir_capacity;
+} dir_sample_t;
+
+static void sample_free(dir_sample_t *s)
+{
+    for (size_t i = 0; i < s->subdir_count; i++) free(s->subdirs[i]);
+    free(s->subdirs);
+    memset(s, 0, sizeof(*s));
+}
+
+static bool sample_push(dir_sample_t *s, char *path)
+{
+    if (s->subdir_count >= s->subdir_capacity)
+    {
+        size_t cap = s->subdir_capacity ? s->subdir_capacity * 2 : 16;
+        char **grown = realloc(s->subdirs, cap * sizeof(char *));
+        if (!grown) return false;
+        s->subdirs = grown;
+        s->subdir_capacity = cap;
+    }
+    s->subdirs[s->subdir_count++] = path;
+    return true;
+}
+
+static bool sample_dir(const char *path,
+                       const estimate_context_t *ctx,
+                       dir_sample_t *s)
+{
+    memset(s, 0, sizeof(*s));
+
+    platform_dir_t *dir = platform_opendir(path);
+    if (!dir) return false;
+
+    const char *entry;
+    while ((entry = platform_readdir(dir)) != NULL)
+    {
+        char *fullpath = path_join(path, entry);
+        if (!fullpath) continue;
+
+        platform_stat_t st;
+        if (!walk_stat_entry(entry,
+                             fullpath,
+                             ctx->excludes,
+                             ctx->exclude_count,
+                             false,
+                             &st))
+        {
+            free(fullpath);
+            continue;
+        }
+
+        if (st.is_directory)
+        {
+            if (!sample_push(s, fullpath)) free(fullpath);
+        }
+        else
+        {
+            s->size += ctx->apparent_size ? st.size_apparent
+                                          : st.size_allocated;
+            s->files++;
+            free(fullpath);
+        }
+    }
+
+    platform_closedir(dir);
+    return true;
+}
+
+// xorshift64*, state kept by the caller so probes need no locking
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t hash_path(const char *path)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *path; path++) h = (h ^ (unsigned char)*path) * 1099511628211ULL;
+    return h;
+}
+
+// removes a random subdirectory from the sample and hands it to the caller
+static char *pick_subdir(dir_sample_t *s, uint64_t *rng)
+{
+    size_t i = (size_t)(next_random(rng) % s->subdir_count);
+    char *path = s->subdirs[i];
+    s->subdirs[i] = NULL;
+    return path;
+}
+
+/*
+ * Knuth's random probe: walk a single random root to leaf path and weight
+ * each visited level by the product of the branching factors above it.
+ * The result is an unbiased estimate of the whole subtree. Returns
+ * whether the path involved a random choice at all.
+ */
+static bool probe(const dir_sample_t *root,
+                  const estimate_context_t *ctx,
+                  uint64_t *rng,
+                  double out[3])
+{
+    out[0] = (double)root->size;
+    out[1] = (double)root->files;
+    out[2] = (double)root->subdir_count;
+    if (root->subdir_count == 0) return false;
+
+    bool chose = root->subdir_count > 1;
+    double weight = (double)root->subdir_count;
+    size_t i = (size_t)(next_random(rng) % root->subdir_count);
+    const char *path = root->subdirs[i];
+    char *owned = NULL;
+
+    for (int level = 0; path && level < MAX_PROBE_DEPTH; level++)
+    {
+        dir_sample_t s;
+        bool ok = sample_dir(path, ctx, &s);
+        free(owned);
+        owned = NULL;
+        path = NULL;
+        if (!ok) break;
+
+        out[0] += weight * (double)s.size;
+        out[1] += weight * (double)s.files;
+        out[2] += weight * (double)s.subdir_count;
+
+        if (s.subdir_count > 0)
+        {
+            chose = chose || s.subdir_count > 1;
+            weight *= (double)s.subdir_count;
+            owned = pick_subdir(&s, rng);
+            path = owned;
+        }
+        sample_free(&s);
+    }
+
+    free(owned);
+    return chose;
+}
+
+// false once the budget of directories to read runs out
+static bool count_exact(const char *path,
+                        const estimate_context_t *ctx,
+                        size_t *budget,
+                        double out[3])
+{
+    if (*budget == 0) return false;
+    (*budget)--;
+
+    dir_sample_t s;
+    if (!sample_dir(path, ctx, &s)) return true; // counts nothing, as walked
+
+    out[0] += (double)s.size;
+    out[1] += (double)s.files;
+    out[2] += (double)s.subdir_count;
+    bool ok = true;
+    for (size_t i = 0; ok && i < s.subdir_count; i++)
+    {
+        ok = count_exact(s.subdirs[i], ctx, budget, out);
+    }
+    sample_free(&s);
+    return ok;
+}
+
+/*
+ * A subtree small enough is counted exactly: that is cheaper than probing
+ * it. A bigger one is probed. Knuth probes are heavy tailed, so a few deep
+ * probes can carry most of the estimate, and the spread they show is then
+ * far too small. While the effective sample size, (sum v)^2 / sum v^2,
+ * stays under MIN_EFFECTIVE_SHARE of the probe count or under
+ * MIN_EFFECTIVE_PROBES, the probes are doubled, up to MAX_PROBE_FACTOR
+ * times the samples asked for. A subtree that is still dominated after
+ * that is reported without an interval.
+ */
+static void estimate_subtree(const char *path,
+                             const dir_sample_t *root,
+                             estimate_context_t *ctx)
+{
+    double exact[3] = { (double)root->size,
+                        (double)root->files,
+                        (double)root->subdir_count };
+    size_t budget = (size_t)ctx->samples * EXACT_DIRS_PER_SAMPLE;
+    bool counted = true;
+    for (size_t i = 0; counted && i < root->subdir_count; i++)
+    {
+        counted = count_exact(root->subdirs[i], ctx, &budget, exact);
+    }
+    if (counted)
+    {
+#pragma omp critical(estimate_merge)
+        {
+            ctx->est_size += exact[0];
+            ctx->est_files += exact[1];
+            ctx->est_dirs += exact[2];
+        }
+        return;
+    }
+
+    uint64_t rng = ctx->seed ^ hash_path(path);
+    if (!rng) rng = 1;
+
+    double sum[3] = { 0 };
+    double sumsq[3] = { 0 };
+    double first[3] = { 0 };
+    bool chose = false;
+    bool spread[3] = { false, false, false };
+    bool dominated = false;
+    int probes = 0;
+    for (int target = ctx->samples;; target *= 2)
+    {
+        for (; probes < target; probes++)
+        {
+            double v[3];
+            chose = probe(root, ctx, &rng, v) || chose;
+            for (int j = 0; j < 3; j++)
+            {
+                if (probes == 0) first[j] = v[j];
+                spread[j] = spread[j] || v[j] != first[j];
+                sum[j] += v[j];
+                sumsq[j] += v[j] * v[j];
+            }
+        }
+
+        dominated = false;
+        for (int j = 0; j < 3; j++)
+        {
+            double effective = sumsq[j] > 0 ? sum[j] * sum[j] / sumsq[j]
+                                            : (double)probes;
+            dominated = dominated ||
+                        effective < MIN_EFFECTIVE_SHARE * (double)probes ||
+                        effective < MIN_EFFECTIVE_PROBES;
+        }
+        if (!dominated || target >= ctx->samples * MAX_PROBE_FACTOR) break;
+    }
+
+    double n = (double)probes;
+    double mean[3];
+    double var[3];
+    for (int j = 0; j < 3; j++)
+    {
+        mean[j] = sum[j] / n;
+        // variance of the mean; a single sample has no spread to report
+        var[j] = probes > 1
+                   ? fmax(0.0, (sumsq[j] - sum[j] * mean[j]) / (n - 1) / n)
+                   : 0.0;
+    }
+
+    // probes that had a choice but all came back equal in one total may
+    // well have missed the one branch that differs, so a zero variance
+    // means nothing either
+    bool uncertain = dominated;
+    for (int j = 0; j < 3; j++) uncertain = uncertain || (chose && !spread[j]);
+
+#pragma omp critical(estimate_merge)
+    {
+        ctx->est_size += mean[0];
+        ctx->est_files += mean[1];
+        ctx->est_dirs += mean[2];
+        ctx->var_size += var[0];
+        ctx->var_files += var[1];
+        ctx->var_dirs += var[2];
+        if (uncertain) ctx->uncertain = true;
+    }
+}
+
+static void estimate_dir(const char *path, estimate_context_t *ctx, int level)
+{
+    dir_sample_t s;
+    if (!sample_dir(path, ctx, &s)) return;
+
+    if (level >= ctx->depth)
+    {
+        estimate_subtree(path, &s, ctx);
+        sample_free(&s);
+        return;
+    }
+
+#pragma omp atomic
+    ctx->total_size += s.size;
+#pragma omp atomic
+    ctx->file_count += s.files;
+#pragma omp atomic
+    ctx->dir_count += s.subdir_count;
+
+    for (size_t i = 0; i < s.subdir_count; i++)
+    {
+        const char *sub = s.subdirs[i];
+#pragma omp task firstprivate(sub, level) shared(ctx)
+        estimate_dir(sub, ctx, level + 1);
+    }
+
+#pragma omp taskwait
+    sample_free(&s);
+}
+
+estimate_result_t estimate_paths(const args_t *args)
+{
+    estimate_context_t ctx = { .excludes = args->excludes,
+                               .exclude_count = args->exclude_count,
+                               .apparent_size = args->apparent_size,
+                               .samples = args->estimate_samples,
+                               .depth = args->estimate_depth,
+                               .seed = args->estimate_seeded
+                                         ? args->estimate_seed
+                                         : (uint64_t)time(NULL) };
+
+#pragma omp parallel
+    {
+#pragma omp single nowait
+        {
+            for (int i = 0; i < args->path_count; i++)
+            {
+                const char *path = args->paths[i];
+                platform_stat_t st;
+
+                if (!platform_stat(path, &st))
+                {
+                    fprintf(stderr, "Error: cannot stat '%s'\n", path);
+                    continue;
+                }
+
+                if (st.is_directory)
+                {
+#pragma omp task firstprivate(path) shared(ctx)
+                    estimate_dir(path, &ctx, 0);
+#pragma omp atomic
+                    ctx.dir_count++;
+                }
+                else
+                {
+#pragma omp atomic
+                    ctx.total_size += args->apparent_size ? st.size_apparent
+                                                          : st.size_allocated;
+#pragma omp atomic
+                    ctx.file_count++;
+                }
+            }
+        }
+    }
+
+    estimate_result_t result = { 0 };
+    result.totals.total_size = ctx.total_size + (uint64_t)(ctx.est_size + 0.5);
+    result.totals.file_count = ctx.file_count + (uint64_t)(ctx.est_files + 0.5);
+    result.totals.dir_count = ctx.dir_count + (uint64_t)(ctx.est_dirs + 0.5);
+    result.size_error = CONFIDENCE_Z * sqrt(ctx.var_size);
+    result.file_error = CONFIDENCE_Z * sqrt(ctx.var_files);
+    result.dir_error = CONFIDENCE_Z * sqrt(ctx.var_dirs);
+    result.uncertain = ctx.uncertain;
+    result.seed = ctx.seed;
+    return result;
+}
@@ -0,0 +1,23 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include "args.h"
+#include "walk.h"
+
+#define ESTIMATE_DEFAULT_SAMPLES 64
+#define ESTIMATE_DEFAULT_DEPTH 2
+
+typedef struct
+{
+    walk_result_t totals;
+    // half width of the 95% confidence interval of each total
+    double size_error;
+    double file_error;
+    double dir_error;
+    bool uncertain; // the probes are too uneven for the errors to mean much
+    uint64_t seed;  // repeats the run with --estimate-seed
+} estimate_result_t;
+
+estimate_result_t estimate_paths(const args_t *args);
+
+#endif
@@ -0,0 +1,283 @@
+#include "ext.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// fixed size open addressing table, so junk names can't grow memory
+// unbounded; once it is 3/4 full a new extension takes the place of the
+// smallest one and inherits its totals (space-saving), so an extension
+// never has its bytes split between its own row and "other", at the cost
+// of rows that may overstate by what they carried over
+#define EXT_TABLE_SLOTS 1024
+#define EXT_TABLE_LIMIT (EXT_TABLE_SLOTS / 4 * 3)
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+typedef struct
+{
+    uint32_t hash;
+    uint8_t len;
+    char name[EXT_NAME_MAX + 1];
+    uint64_t size;
+    uint64_t count;
+    uint64_t carried; // bytes inherited from entries pushed out
+} ext_entry_t;
+
+struct ext_table
+{
+    ext_entry_t slots[EXT_TABLE_SLOTS];
+    int used;
+    // min-heap of the used slots by size, and where each slot sits in it
+    uint16_t heap[EXT_TABLE_LIMIT];
+    uint16_t heap_pos[EXT_TABLE_SLOTS];
+    ext_entry_t none;
+    ext_entry_t other;
+};
+
+ext_table_t *ext_table_create(void)
+{
+    ext_table_t *table = calloc(1, sizeof(ext_table_t));
+    if (!table) return NULL;
+
+    memcpy(table->none.name, "(none)", 7);
+    memcpy(table->other.name, "(other)", 8);
+    return table;
+}
+
+void ext_table_free(ext_table_t *table)
+{
+    free(table);
+}
+
+static inline void bucket_add(ext_entry_t *e, uint64_t size, uint64_t count)
+{
+    e->size += size;
+    e->count += count;
+}
+
+static inline uint64_t heap_key(const ext_table_t *table, size_t k)
+{
+    return table->slots[table->heap[k]].size;
+}
+
+static inline void heap_set(ext_table_t *table, size_t k, size_t slot)
+{
+    table->heap[k] = (uint16_t)slot;
+    table->heap_pos[slot] = (uint16_t)k;
+}
+
+static void sift_up(ext_table_t *table, size_t k)
+{
+    size_t slot = table->heap[k];
+    uint64_t key = table->slots[slot].size;
+    while (k > 0 && heap_key(table, (k - 1) / 2) > key)
+    {
+        heap_set(table, k, table->heap[(k - 1) / 2]);
+        k = (k - 1) / 2;
+    }
+    heap_set(table, k, slot);
+}
+
+// entries only grow, so this is all an add needs
+static void sift_down(ext_table_t *table, size_t k)
+{
+    size_t n = (size_t)table->used;
+    size_t slot = table->heap[k];
+    uint64_t key = table->slots[slot].size;
+    for (;;)
+    {
+        size_t c = 2 * k + 1;
+        if (c >= n) break;
+        if (c + 1 < n && heap_key(table, c + 1) < heap_key(table, c)) c++;
+        if (heap_key(table, c) >= key) break;
+        heap_set(table, k, table->heap[c]);
+        k = c;
+    }
+    heap_set(table, k, slot);
+}
+
+// true when slot k lies in the cyclic range (i, j]
+static inline bool between(size_t i, size_t k, size_t j)
+{
+    return i <= j ? i < k && k <= j : i < k || k <= j;
+}
+
+// backward shift deletion, so no probe chain is broken by the hole; the
+// heap follows the entries that move, and its node for slot i is left to
+// the caller
+static void remove_slot(ext_table_t *table, size_t i)
+{
+    size_t mask = EXT_TABLE_SLOTS - 1;
+    for (size_t j = (i + 1) & mask; table->slots[j].count;
+         j = (j + 1) & mask)
+    {
+        if (!between(i, table->slots[j].hash & mask, j))
+        {
+            table->slots[i] = table->slots[j];
+            heap_set(table, table->heap_pos[j], i);
+            i = j;
+        }
+    }
+    memset(&table->slots[i], 0, sizeof(ext_entry_t));
+}
+
+// the slot holding ext, or the empty one where it belongs
+static size_t find_slot(const ext_table_t *table,
+                        const char *ext,
+                        size_t len,
+                        uint32_t hash)
+{
+    size_t mask = EXT_TABLE_SLOTS - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        const ext_entry_t *e = &table->slots[i];
+        if (e->count == 0 ||
+            (e->hash == hash && e->len == len &&
+             memcmp(e->name, ext, len) == 0))
+        {
+            return i;
+        }
+    }
+}
+
+static void insert(ext_table_t *table,
+                   const char *ext,
+                   size_t len,
+                   uint32_t hash,
+                   uint64_t size,
+                   uint64_t count,
+                   uint64_t carried)
+{
+    size_t i = find_slot(table, ext, len, hash);
+    ext_entry_t *e = &table->slots[i];
+    if (e->count)
+    {
+        bucket_add(e, size, count);
+        e->carried += carried;
+        sift_down(table, table->heap_pos[i]);
+        return;
+    }
+
+    size_t at = (size_t)table->used;
+    if (table->used >= EXT_TABLE_LIMIT)
+    {
+        // the smallest entry makes room, and its totals stay with the
+        // newcomer rather than moving to "other"
+        size_t min = table->heap[0];
+        ext_entry_t old = table->slots[min];
+        size += old.size;
+        count += old.count;
+        carried += old.size;
+        remove_slot(table, min);
+        i = find_slot(table, ext, len, hash);
+        e = &table->slots[i];
+        at = 0;
+    }
+    else
+    {
+        table->used++;
+    }
+
+    e->hash = hash;
+    e->len = (uint8_t)len;
+    memcpy(e->name, ext, len);
+    e->name[len] = '\0';
+    e->carried = carried;
+    bucket_add(e, size, count);
+    heap_set(table, at, i);
+    if (at == 0)
+    {
+        sift_down(table, 0);
+    }
+    else
+    {
+        sift_up(table, at);
+    }
+}
+
+void ext_table_add(ext_table_t *table, const char *name, uint64_t size)
+{
+    if (!table || !name) return;
+
+    // leading dot is a hidden file, not an extension
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name || dot[1] == '\0')
+    {
+        bucket_add(&table->none, size, 1);
+        return;
+    }
+
+    const char *ext = dot + 1;
+    uint32_t hash = FNV_OFFSET;
+    size_t len = 0;
+    for (; ext[len]; len++)
+    {
+        if (len >= EXT_NAME_MAX)
+        {
+            bucket_add(&table->other, size, 1);
+            return;
+        }
+        hash = (hash ^ (unsigned char)ext[len]) * FNV_PRIME;
+    }
+
+    insert(table, ext, len, hash, size, 1, 0);
+}
+
+void ext_table_merge(ext_table_t *dst, const ext_table_t *src)
+{
+    if (!dst || !src) return;
+
+    for (size_t i = 0; i < EXT_TABLE_SLOTS; i++)
+    {
+        const ext_entry_t *e = &src->slots[i];
+        if (e->count == 0) continue;
+        insert(
+          dst, e->name, e->len, e->hash, e->size, e->count, e->carried);
+    }
+    bucket_add(&dst->none, src->none.size, src->none.count);
+    bucket_add(&dst->other, src->other.size, src->other.count);
+}
+
+static int compare_size_desc(const void *a, const void *b)
+{
+    const ext_entry_t *ea = *(const ext_entry_t *const *)a;
+    const ext_entry_t *eb = *(const ext_entry_t *const *)b;
+    if (ea->size != eb->size) return ea->size < eb->size ? 1 : -1;
+    return strcmp(ea->name, eb->name);
+}
+
+void ext_table_print(const ext_table_t *table)
+{
+    if (!table) return;
+
+    const ext_entry_t *sorted[EXT_TABLE_LIMIT + 2];
+    size_t n = 0;
+
+    for (size_t i = 0; i < EXT_TABLE_SLOTS; i++)
+    {
+        if (table->slots[i].count) sorted[n++] = &table->slots[i];
+    }
+    if (table->none.count) sorted[n++] = &table->none;
+    if (table->other.count) sorted[n++] = &table->other;
+
+    qsort(sorted, n, sizeof(sorted[0]), compare_size_desc);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        char buf[32];
+        const bool bucket = sorted[i] == &table->none ||
+                            sorted[i] == &table->other;
+        printf("%-10s %10lu  %s%s",
+               human_size(sorted[i]->size, buf, sizeof(buf)),
+               sorted[i]->count,
+               bucket ? "" : ".",
+               sorted[i]->name);
+        if (sorted[i]->carried)
+        {
+            printf(" (up to %s carried over from other extensions)",
+                   human_size(sorted[i]->carried, buf, sizeof(buf)));
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef EXT_H
+#define EXT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// longer extensions are accounted in the "other" bucket
+#define EXT_NAME_MAX 15
+
+typedef struct ext_table ext_table_t;
+
+ext_table_t *ext_table_create(void);
+void ext_table_free(ext_table_t *table);
+void ext_table_add(ext_table_t *table, const char *name, uint64_t size);
+void ext_table_merge(ext_table_t *dst, const ext_table_t *src);
+void ext_table_print(const ext_table_t *table);
+
+#endif
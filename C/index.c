@@ -0,0 +1,280 @@
+#include "index.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_ITEMS 1024
+#define INITIAL_NAMES (64 * 1024)
+
+struct index_item
+{
+    size_t name; // offset into the buffer's name arena
+    uint64_t size;
+    uint64_t files;
+    uint64_t dirs;
+};
+
+bool index_buf_push(index_buf_t *buf,
+                    const char *path,
+                    uint64_t size,
+                    uint64_t files,
+                    uint64_t dirs)
+{
+    size_t len = strlen(path) + 1;
+
+    if (buf->count >= buf->capacity)
+    {
+        size_t cap = buf->capacity ? buf->capacity * 2 : INITIAL_ITEMS;
+        struct index_item *grown =
+          realloc(buf->items, cap * sizeof(struct index_item));
+        if (!grown) return false;
+        buf->items = grown;
+        buf->capacity = cap;
+    }
+
+    if (buf->names_len + len > buf->names_capacity)
+    {
+        size_t cap = buf->names_capacity ? buf->names_capacity : INITIAL_NAMES;
+        while (cap < buf->names_len + len) cap *= 2;
+        char *grown = realloc(buf->names, cap);
+        if (!grown) return false;
+        buf->names = grown;
+        buf->names_capacity = cap;
+    }
+
+    memcpy(buf->names + buf->names_len, path, len);
+    struct index_item *item = &buf->items[buf->count++];
+    item->name = buf->names_len;
+    item->size = size;
+    item->files = files;
+    item->dirs = dirs;
+    buf->names_len += len;
+    return true;
+}
+
+void index_buf_free(index_buf_t *buf)
+{
+    free(buf->items);
+    free(buf->names);
+    memset(buf, 0, sizeof(*buf));
+}
+
+// byte order, except that '/' sorts right after the end of the string
+static int compare_path(const char *a, const char *b)
+{
+    const unsigned char *x = (const unsigned char *)a;
+    const unsigned char *y = (const unsigned char *)b;
+    while (*x && *x == *y)
+    {
+        x++;
+        y++;
+    }
+    unsigned cx = *x == '/' ? 1u : *x ? *x + 1u : 0u;
+    unsigned cy = *y == '/' ? 1u : *y ? *y + 1u : 0u;
+    return (cx > cy) - (cx < cy);
+}
+
+static int compare_entry(const void *a, const void *b)
+{
+    return compare_path(((const index_entry_t *)a)->path,
+                        ((const index_entry_t *)b)->path);
+}
+
+static bool is_ancestor(const char *dir, const char *path)
+{
+    size_t len = strlen(dir);
+    if (strncmp(dir, path, len) != 0 || path[len] == '\0') return false;
+    return path[len] == '/' || (len > 0 && dir[len - 1] == '/');
+}
+
+/*
+ * Walks the sorted entries with a stack of open ancestors. An entry is
+ * closed when the next path is outside its subtree, and its totals are
+ * then added to the ancestor below it on the stack.
+ */
+static bool roll_up(index_entry_t *e, size_t n)
+{
+    size_t *stack = malloc((n ? n : 1) * sizeof(size_t));
+    if (!stack) return false;
+
+    size_t depth = 0;
+    for (size_t i = 0; i <= n; i++)
+    {
+        while (depth &&
+               (i == n || !is_ancestor(e[stack[depth - 1]].path, e[i].path)))
+        {
+            index_entry_t *done = &e[stack[--depth]];
+            done->end = i;
+            if (depth)
+            {
+                index_entry_t *parent = &e[stack[depth - 1]];
+                parent->size += done->size;
+                parent->files += done->files;
+                parent->dirs += done->dirs;
+            }
+        }
+        if (i < n) stack[depth++] = i;
+    }
+
+    // dirs counted subdirectories so far; each directory counts itself too
+    for (size_t i = 0; i < n; i++) e[i].dirs++;
+
+    free(stack);
+    return true;
+}
+
+dir_index_t *index_build(index_buf_t *bufs, int count)
+{
+    dir_index_t *index = calloc(1, sizeof(dir_index_t));
+    size_t n = 0;
+    for (int i = 0; i < count; i++) n += bufs[i].count;
+
+    if (index)
+    {
+        index->entries = malloc((n ? n : 1) * sizeof(index_entry_t));
+        index->arenas = calloc(count > 0 ? (size_t)count : 1, sizeof(char *));
+    }
+
+    bool ok = index && index->entries && index->arenas;
+    for (int i = 0; i < count; i++)
+    {
+        for (size_t j = 0; ok && j < bufs[i].count; j++)
+        {
+            const struct index_item *item = &bufs[i].items[j];
+            index_entry_t *e = &index->entries[index->count++];
+            e->path = bufs[i].names + item->name;
+            e->size = item->size;
+            e->files = item->files;
+            e->dirs = item->dirs;
+            e->end = 0;
+        }
+        if (ok)
+        {
+            index->arenas[index->arena_count++] = bufs[i].names;
+            bufs[i].names = NULL;
+        }
+        index_buf_free(&bufs[i]);
+    }
+
+    if (ok)
+    {
+        qsort(index->entries,
+              index->count,
+              sizeof(index_entry_t),
+              compare_entry);
+
+        // overlapping roots list a directory twice; keep the first
+        size_t kept = 0;
+        for (size_t i = 0; i < index->count; i++)
+        {
+            if (kept && strcmp(index->entries[kept - 1].path,
+                               index->entries[i].path) == 0)
+            {
+                continue;
+            }
+            index->entries[kept++] = index->entries[i];
+        }
+        index->count = kept;
+        ok = roll_up(index->entries, index->count);
+    }
+
+    if (!ok)
+    {
+        index_free(index);
+        return NULL;
+    }
+    index->built = platform_time();
+    return index;
+}
+
+void index_free(dir_index_t *index)
+{
+    if (!index) return;
+    for (int i = 0; i < index->arena_count; i++) free(index->arenas[i]);
+    free(index->arenas);
+    free(index->entries);
+    free(index);
+}
+
+const index_entry_t *index_find(const dir_index_t *index, const char *path)
+{
+    size_t lo = 0;
+    size_t hi = index->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = compare_path(index->entries[mid].path, path);
+        if (c == 0) return &index->entries[mid];
+        if (c < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// min-heap on size, so the root is the smallest of the current top n
+static void sift_down(const index_entry_t **heap, size_t count, size_t i)
+{
+    for (;;)
+    {
+        size_t least = i;
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+        if (l < count && heap[l]->size < heap[least]->size) least = l;
+        if (r < count && heap[r]->size < heap[least]->size) least = r;
+        if (least == i) return;
+        const index_entry_t *swap = heap[i];
+        heap[i] = heap[least];
+        heap[least] = swap;
+        i = least;
+    }
+}
+
+size_t index_top(const dir_index_t *index,
+                 const index_entry_t *entry,
+                 const index_entry_t **out,
+                 size_t n)
+{
+    if (n == 0) return 0;
+
+    size_t count = 0;
+    size_t first = (size_t)(entry - index->entries) + 1;
+    for (size_t i = first; i < entry->end; i++)
+    {
+        const index_entry_t *e = &index->entries[i];
+        if (count < n)
+        {
+            // sift up
+            size_t k = count++;
+            out[k] = e;
+            while (k > 0 && out[(k - 1) / 2]->size > out[k]->size)
+            {
+                const index_entry_t *swap = out[k];
+                out[k] = out[(k - 1) / 2];
+                out[(k - 1) / 2] = swap;
+                k = (k - 1) / 2;
+            }
+        }
+        else if (e->size > out[0]->size)
+        {
+            out[0] = e;
+            sift_down(out, count, 0);
+        }
+    }
+
+    // heap sort in place; popping the minimum to the back leaves the
+    // array in descending order
+    for (size_t end = count; end > 1; end--)
+    {
+        const index_entry_t *swap = out[0];
+        out[0] = out[end - 1];
+        out[end - 1] = swap;
+        sift_down(out, end - 1, 0);
+    }
+    return count;
+}
@@ -0,0 +1,62 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Per-directory totals of a finished walk, kept for queries. Entries are
+ * sorted so that every directory is directly followed by its subtree
+ * ('/' orders before any other byte), which turns "everything under X"
+ * into the range [entry + 1, entries + entry->end).
+ */
+typedef struct
+{
+    const char *path;
+    uint64_t size;  // whole subtree
+    uint64_t files; // whole subtree
+    uint64_t dirs;  // whole subtree, the directory itself included
+    size_t end;     // index one past the last descendant
+} index_entry_t;
+
+typedef struct
+{
+    index_entry_t *entries;
+    size_t count;
+    char **arenas; // path storage, taken over from the workers
+    int arena_count;
+    double built; // platform_time() when the walk finished
+} dir_index_t;
+
+// per-thread, append only; sizes and counts of a directory's own entries
+typedef struct
+{
+    struct index_item *items;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_len;
+    size_t names_capacity;
+} index_buf_t;
+
+bool index_buf_push(index_buf_t *buf,
+                    const char *path,
+                    uint64_t size,
+                    uint64_t files,
+                    uint64_t dirs);
+void index_buf_free(index_buf_t *buf);
+
+// consumes the buffers (also on failure) and rolls totals up the tree
+dir_index_t *index_build(index_buf_t *bufs, int count);
+void index_free(dir_index_t *index);
+
+const index_entry_t *index_find(const dir_index_t *index, const char *path);
+
+// largest directories below entry, biggest first; returns how many
+size_t index_top(const dir_index_t *index,
+                 const index_entry_t *entry,
+                 const index_entry_t **out,
+                 size_t n);
+
+#endif
@@ -1,4 +1,7 @@
 #include "args.h"
+#include "estimate.h"
+#include "serve.h"
+#include "throttle.h"
 #include "util.h"
 #include "walk.h"
 #include <stdio.h>
@@ -28,20 +31,81 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    walk_result_t result = walk_paths(args.paths,
-                                      args.path_count,
-                                      args.excludes,
-                                      args.exclude_count,
-                                      args.apparent_size,
-                                      args.verbose,
-                                      args.quiet);
+    throttle_configure((uint64_t)args.max_iops,
+                       (uint64_t)args.latency_target_us);
+
+    if (args.serve)
+    {
+        int status = serve_run(&args);
+        args_free(&args);
+        return status;
+    }
+
+    if (args.estimate)
+    {
+        estimate_result_t est = estimate_paths(&args);
+        char size_str[32];
+        char err_str[32];
+        if (est.uncertain)
+        {
+            printf("\nEstimate: %s (%lu files, %lu directories, "
+                   "low confidence, no 95%% interval)\n",
+                   human_size(
+                     est.totals.total_size, size_str, sizeof(size_str)),
+                   est.totals.file_count,
+                   est.totals.dir_count);
+        }
+        else
+        {
+            printf("\nEstimate: %s +/- %s (%lu +/- %.0f files, "
+                   "%lu +/- %.0f directories, 95%% confidence)\n",
+                   human_size(
+                     est.totals.total_size, size_str, sizeof(size_str)),
+                   human_size(
+                     (uint64_t)est.size_error, err_str, sizeof(err_str)),
+                   est.totals.file_count,
+                   est.file_error,
+                   est.totals.dir_count,
+                   est.dir_error);
+        }
+        printf("Seed: %lu\n", est.seed);
+        args_free(&args);
+        return 0;
+    }
+
+    walk_result_t result = walk_paths(&args);
+    if (result.failed)
+    {
+        walk_result_free(&result);
+        args_free(&args);
+        return 1;
+    }
+
+    if (result.extensions)
+    {
+        printf("\n");
+        ext_table_print(result.extensions);
+    }
 
     char size_str[32];
-    printf("\nTotal: %s (%lu files, %lu directories)\n",
+    printf("\n%s: %s (%lu files, %lu directories)\n",
+           result.partial ? "Partial" : "Total",
            human_size(result.total_size, size_str, sizeof(size_str)),
            result.file_count,
            result.dir_count);
 
+    if (result.partial)
+    {
+        printf("Time limit reached; %lu directories not visited:\n",
+               (unsigned long)result.unvisited_count);
+        for (size_t i = 0; i < result.unvisited_count; i++)
+        {
+            printf("  %s\n", result.unvisited[i]);
+        }
+    }
+
+    walk_result_free(&result);
+
     args_free(&args);
     return 0;
 }
@@ -1,4 +1,10 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE // sched_setaffinity
+#endif
+
 #include "platform.h"
+#include "shim.h"
+#include "throttle.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -15,6 +21,7 @@ struct platform_dir
     HANDLE handle;
     WIN32_FIND_DATAW find_data;
     bool first;
+    unsigned long reads;
     char name_buffer[PATH_BUFFER_SIZE];
 };
 
@@ -33,14 +40,31 @@ static bool get_compressed_size(const wchar_t *wpath, uint64_t *size)
     return true;
 }
 
-bool platform_stat(const char *path, platform_stat_t *st)
+static bool get_file_id(const wchar_t *wpath, uint64_t *dev, uint64_t *ino)
 {
-    wchar_t wpath[MAX_PATH];
-    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH) == 0)
+    HANDLE h = CreateFileW(wpath,
+                           0,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE |
+                             FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS,
+                           NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    bool ok = GetFileInformationByHandle(h, &info) != 0;
+    CloseHandle(h);
+    if (ok)
     {
-        return false;
+        *dev = info.dwVolumeSerialNumber;
+        *ino = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
     }
+    return ok;
+}
 
+static bool stat_attributes(const wchar_t *wpath, platform_stat_t *st)
+{
     WIN32_FILE_ATTRIBUTE_DATA attr;
     if (!GetFileAttributesExW(wpath, GetFileExInfoStandard, &attr))
     {
@@ -48,6 +72,10 @@ bool platform_stat(const char *path, platform_stat_t *st)
     }
 
     st->is_directory = (attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    st->is_symlink =
+      (attr.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    st->dev = 0;
+    st->ino = 0;
 
     ULARGE_INTEGER size;
     size.LowPart = attr.nFileSizeLow;
@@ -62,6 +90,41 @@ bool platform_stat(const char *path, platform_stat_t *st)
     return true;
 }
 
+bool platform_stat(const char *path, platform_stat_t *st)
+{
+    wchar_t wpath[MAX_PATH];
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH) == 0)
+    {
+        return false;
+    }
+
+    double t0 = throttle_begin();
+    bool ok = stat_attributes(wpath, st);
+    if (ok)
+    {
+        // opening a directory follows its reparse point, so this is the
+        // target
+        st->is_symlink = false;
+        if (st->is_directory) get_file_id(wpath, &st->dev, &st->ino);
+    }
+    throttle_end(t0);
+    return ok;
+}
+
+bool platform_lstat(const char *path, platform_stat_t *st)
+{
+    wchar_t wpath[MAX_PATH];
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH) == 0)
+    {
+        return false;
+    }
+
+    double t0 = throttle_begin();
+    bool ok = stat_attributes(wpath, st);
+    throttle_end(t0);
+    return ok;
+}
+
 bool platform_is_directory(const char *path)
 {
     wchar_t wpath[MAX_PATH];
@@ -69,7 +132,9 @@ bool platform_is_directory(const char *path)
     {
         return false;
     }
+    double t0 = throttle_begin();
     DWORD attr = GetFileAttributesW(wpath);
+    throttle_end(t0);
     return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
 }
 
@@ -97,7 +162,9 @@ platform_dir_t *platform_opendir(const char *path)
         return NULL;
     }
 
+    double t0 = throttle_begin();
     dir->handle = FindFirstFileW(wsearch, &dir->find_data);
+    throttle_end(t0);
     if (dir->handle == INVALID_HANDLE_VALUE)
     {
         free(dir);
@@ -105,6 +172,7 @@ platform_dir_t *platform_opendir(const char *path)
     }
 
     dir->first = true;
+    dir->reads = 0;
     return dir;
 }
 
@@ -118,9 +186,10 @@ const char *platform_readdir(platform_dir_t *dir)
         {
             dir->first = false;
         }
-        else if (!FindNextFileW(dir->handle, &dir->find_data))
+        else
         {
-            return NULL;
+            throttle_readdir(dir->reads++);
+            if (!FindNextFileW(dir->handle, &dir->find_data)) return NULL;
         }
 
         if (WideCharToMultiByte(CP_UTF8,
@@ -165,7 +234,9 @@ bool is_symlink(const char *path)
         return false;
     }
 
+    double t0 = throttle_begin();
     DWORD attrs = GetFileAttributesW(wpath);
+    throttle_end(t0);
     if (attrs == INVALID_FILE_ATTRIBUTES)
     {
         return false;
@@ -174,11 +245,213 @@ bool is_symlink(const char *path)
     return (attrs & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
 }
 
+// only made absolute: links are left as they are
+char *platform_realpath(const char *path)
+{
+    return _fullpath(NULL, path, 0);
+}
+
+struct platform_thread
+{
+    HANDLE handle;
+    void (*fn)(void *);
+    void *arg;
+};
+
+struct platform_mutex
+{
+    SRWLOCK lock;
+};
+
+double platform_time(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+}
+
+void platform_sleep_ms(unsigned ms)
+{
+    Sleep(ms);
+}
+
+bool platform_replace_file(const char *from, const char *to)
+{
+    wchar_t wfrom[MAX_PATH];
+    wchar_t wto[MAX_PATH];
+    if (MultiByteToWideChar(CP_UTF8, 0, from, -1, wfrom, MAX_PATH) == 0 ||
+        MultiByteToWideChar(CP_UTF8, 0, to, -1, wto, MAX_PATH) == 0)
+    {
+        return false;
+    }
+    return MoveFileExW(wfrom, wto, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static DWORD WINAPI thread_main(LPVOID param)
+{
+    platform_thread_t *thread = param;
+    thread->fn(thread->arg);
+    return 0;
+}
+
+platform_thread_t *platform_thread_start(void (*fn)(void *), void *arg)
+{
+    platform_thread_t *thread = malloc(sizeof(platform_thread_t));
+    if (!thread) return NULL;
+
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
+    if (!thread->handle)
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void platform_thread_join(platform_thread_t *thread)
+{
+    if (!thread) return;
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+platform_mutex_t *platform_mutex_create(void)
+{
+    platform_mutex_t *mutex = malloc(sizeof(platform_mutex_t));
+    if (mutex) InitializeSRWLock(&mutex->lock);
+    return mutex;
+}
+
+void platform_mutex_lock(platform_mutex_t *mutex)
+{
+    AcquireSRWLockExclusive(&mutex->lock);
+}
+
+void platform_mutex_unlock(platform_mutex_t *mutex)
+{
+    ReleaseSRWLockExclusive(&mutex->lock);
+}
+
+void platform_mutex_free(platform_mutex_t *mutex)
+{
+    free(mutex);
+}
+
+// processor group 0 only, i.e. at most 64 CPUs
+int platform_cpu_topology(int *cpus, int *nodes, int max)
+{
+    DWORD_PTR process_mask, system_mask;
+    if (!GetProcessAffinityMask(
+          GetCurrentProcess(), &process_mask, &system_mask))
+    {
+        return 0;
+    }
+
+    int n = 0;
+    for (int cpu = 0; cpu < 64 && n < max; cpu++)
+    {
+        if (!(process_mask & ((DWORD_PTR)1 << cpu))) continue;
+
+        UCHAR node = 0;
+        cpus[n] = cpu;
+        nodes[n] = GetNumaProcessorNode((UCHAR)cpu, &node) ? node : 0;
+        n++;
+    }
+    return n;
+}
+
+bool platform_pin_thread(int cpu)
+{
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+struct platform_shm
+{
+    HANDLE mapping;
+    void *data;
+};
+
+platform_shm_t *platform_shm_create(const char *name,
+                                    size_t size,
+                                    bool *existed)
+{
+    wchar_t wname[MAX_PATH];
+    if (MultiByteToWideChar(CP_UTF8, 0, name, -1, wname, MAX_PATH) == 0)
+    {
+        return NULL;
+    }
+
+    platform_shm_t *shm = malloc(sizeof(platform_shm_t));
+    if (!shm) return NULL;
+
+    // the mapping lives as long as a handle to it is open
+    shm->mapping = CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                      NULL,
+                                      PAGE_READWRITE,
+                                      (DWORD)((uint64_t)size >> 32),
+                                      (DWORD)size,
+                                      wname);
+    *existed = shm->mapping && GetLastError() == ERROR_ALREADY_EXISTS;
+    shm->data = shm->mapping
+                  ? MapViewOfFile(shm->mapping, FILE_MAP_WRITE, 0, 0, size)
+                  : NULL;
+    if (!shm->data)
+    {
+        if (shm->mapping) CloseHandle(shm->mapping);
+        free(shm);
+        return NULL;
+    }
+    return shm;
+}
+
+void *platform_shm_data(platform_shm_t *shm)
+{
+    return shm->data;
+}
+
+void platform_shm_close(platform_shm_t *shm)
+{
+    if (!shm) return;
+    UnmapViewOfFile(shm->data);
+    CloseHandle(shm->mapping);
+    free(shm);
+}
+
+uint64_t platform_pid(void)
+{
+    return GetCurrentProcessId();
+}
+
+bool platform_process_alive(uint64_t pid)
+{
+    HANDLE process =
+      OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+    if (!process) return GetLastError() == ERROR_ACCESS_DENIED;
+
+    DWORD code = 0;
+    bool alive = GetExitCodeProcess(process, &code) && code == STILL_ACTIVE;
+    CloseHandle(process);
+    return alive;
+}
+
 #else // POSIX
 
+    #include <ctype.h>
     #include <dirent.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <signal.h>
+    #include <stdio.h>
+    #include <sys/mman.h>
     #include <sys/stat.h>
     #include <sys/types.h>
+    #include <time.h>
     #include <unistd.h>
 
     #define BLOCK_SIZE 512
@@ -187,32 +460,55 @@ struct platform_dir
 {
     DIR *dir;
     struct dirent *entry;
+    unsigned long reads;
 };
 
-bool platform_stat(const char *path, platform_stat_t *st)
+static void fill_stat(const struct stat *sb, platform_stat_t *st)
 {
-    struct stat sb;
-    if (stat(path, &sb) != 0)
-    {
-        return false;
-    }
-
-    st->is_directory = S_ISDIR(sb.st_mode);
-    st->size_apparent = (uint64_t)sb.st_size;
+    st->is_directory = S_ISDIR(sb->st_mode);
+    st->is_symlink = S_ISLNK(sb->st_mode);
+    st->size_apparent = (uint64_t)sb->st_size;
 
     #if defined(__APPLE__) || defined(__linux__)
-    st->size_allocated = (uint64_t)sb.st_blocks * BLOCK_SIZE;
+    st->size_allocated = (uint64_t)sb->st_blocks * BLOCK_SIZE;
     #else
     st->size_allocated = st->size_apparent;
     #endif
 
-    return true;
+    st->dev = (uint64_t)sb->st_dev;
+    st->ino = (uint64_t)sb->st_ino;
+}
+
+bool platform_stat(const char *path, platform_stat_t *st)
+{
+    double t0 = throttle_begin();
+    SHIM_HOOK(SHIM_STAT);
+    struct stat sb;
+    bool ok = stat(path, &sb) == 0;
+    throttle_end(t0);
+    if (ok) fill_stat(&sb, st);
+    return ok;
+}
+
+bool platform_lstat(const char *path, platform_stat_t *st)
+{
+    double t0 = throttle_begin();
+    SHIM_HOOK(SHIM_LSTAT);
+    struct stat sb;
+    bool ok = lstat(path, &sb) == 0;
+    throttle_end(t0);
+    if (ok) fill_stat(&sb, st);
+    return ok;
 }
 
 bool platform_is_directory(const char *path)
 {
+    double t0 = throttle_begin();
+    SHIM_HOOK(SHIM_STAT);
     struct stat sb;
-    return stat(path, &sb) == 0 && S_ISDIR(sb.st_mode);
+    bool ok = stat(path, &sb) == 0;
+    throttle_end(t0);
+    return ok && S_ISDIR(sb.st_mode);
 }
 
 uint64_t platform_file_size(const char *path, bool apparent)
@@ -228,7 +524,11 @@ platform_dir_t *platform_opendir(const char *path)
     platform_dir_t *dir = malloc(sizeof(platform_dir_t));
     if (!dir) return NULL;
 
+    double t0 = throttle_begin();
+    SHIM_HOOK(SHIM_OPENDIR);
+    dir->reads = 0;
     dir->dir = opendir(path);
+    throttle_end(t0);
     if (!dir->dir)
     {
         free(dir);
@@ -243,6 +543,9 @@ const char *platform_readdir(platform_dir_t *dir)
 {
     if (!dir || !dir->dir) return NULL;
 
+    unsigned long index = dir->reads++;
+    SHIM_READDIR(index);
+    throttle_readdir(index);
     while ((dir->entry = readdir(dir->dir)) != NULL)
     {
         const char *name = dir->entry->d_name;
@@ -267,8 +570,257 @@ void platform_closedir(platform_dir_t *dir)
 
 bool is_symlink(const char *path)
 {
+    double t0 = throttle_begin();
+    SHIM_HOOK(SHIM_LSTAT);
     struct stat st;
-    if (lstat(path, &st) != 0) return false;
-    return S_ISLNK(st.st_mode);
+    bool ok = lstat(path, &st) == 0;
+    throttle_end(t0);
+    return ok && S_ISLNK(st.st_mode);
+}
+
+char *platform_realpath(const char *path)
+{
+    double t0 = throttle_begin();
+    char *resolved = realpath(path, NULL);
+    throttle_end(t0);
+    return resolved;
+}
+
+struct platform_thread
+{
+    pthread_t handle;
+    void (*fn)(void *);
+    void *arg;
+};
+
+struct platform_mutex
+{
+    pthread_mutex_t lock;
+};
+
+double platform_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void platform_sleep_ms(unsigned ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000,
+                           .tv_nsec = (long)(ms % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) != 0) continue;
+}
+
+bool platform_replace_file(const char *from, const char *to)
+{
+    return rename(from, to) == 0;
+}
+
+static void *thread_main(void *param)
+{
+    platform_thread_t *thread = param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+platform_thread_t *platform_thread_start(void (*fn)(void *), void *arg)
+{
+    platform_thread_t *thread = malloc(sizeof(platform_thread_t));
+    if (!thread) return NULL;
+
+    thread->fn = fn;
+    thread->arg = arg;
+    if (pthread_create(&thread->handle, NULL, thread_main, thread) != 0)
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void platform_thread_join(platform_thread_t *thread)
+{
+    if (!thread) return;
+    pthread_join(thread->handle, NULL);
+    free(thread);
+}
+
+platform_mutex_t *platform_mutex_create(void)
+{
+    platform_mutex_t *mutex = malloc(sizeof(platform_mutex_t));
+    if (mutex && pthread_mutex_init(&mutex->lock, NULL) != 0)
+    {
+        free(mutex);
+        return NULL;
+    }
+    return mutex;
+}
+
+void platform_mutex_lock(platform_mutex_t *mutex)
+{
+    pthread_mutex_lock(&mutex->lock);
+}
+
+void platform_mutex_unlock(platform_mutex_t *mutex)
+{
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+void platform_mutex_free(platform_mutex_t *mutex)
+{
+    if (!mutex) return;
+    pthread_mutex_destroy(&mutex->lock);
+    free(mutex);
 }
+
+struct platform_shm
+{
+    void *data;
+    size_t size;
+};
+
+platform_shm_t *platform_shm_create(const char *name,
+                                    size_t size,
+                                    bool *existed)
+{
+    platform_shm_t *shm = malloc(sizeof(platform_shm_t));
+    if (!shm) return NULL;
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    *existed = fd < 0 && errno == EEXIST;
+    if (*existed) fd = shm_open(name, O_RDWR, 0);
+
+    // an existing object may be short (an older layout); growing it
+    // zero fills the rest, and the mapping never reaches past its end
+    struct stat sb;
+    void *data = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &sb) == 0 &&
+        ((uint64_t)sb.st_size >= size || ftruncate(fd, (off_t)size) == 0))
+    {
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0) close(fd);
+    if (data == MAP_FAILED)
+    {
+        if (fd >= 0 && !*existed) shm_unlink(name);
+        free(shm);
+        return NULL;
+    }
+
+    shm->data = data;
+    shm->size = size;
+    return shm;
+}
+
+void *platform_shm_data(platform_shm_t *shm)
+{
+    return shm->data;
+}
+
+void platform_shm_close(platform_shm_t *shm)
+{
+    if (!shm) return;
+    munmap(shm->data, shm->size);
+    free(shm);
+}
+
+uint64_t platform_pid(void)
+{
+    return (uint64_t)getpid();
+}
+
+bool platform_process_alive(uint64_t pid)
+{
+    return pid > 0 && pid <= INT32_MAX &&
+           (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
+    #ifdef __linux__
+        #include <sched.h>
+
+// marks the CPUs of a sysfs cpulist such as "0-3,8-11" with `node`
+static void read_node_cpus(const char *file,
+                           int node,
+                           const int *cpus,
+                           int *nodes,
+                           int n)
+{
+    FILE *fp = fopen(file, "r");
+    if (!fp) return;
+
+    char list[4096];
+    if (!fgets(list, sizeof(list), fp)) list[0] = '\0';
+    fclose(fp);
+
+    for (char *p = list; isdigit((unsigned char)*p);)
+    {
+        long lo = strtol(p, &p, 10);
+        long hi = lo;
+        if (*p == '-') hi = strtol(p + 1, &p, 10);
+        if (*p == ',') p++;
+
+        for (int i = 0; i < n; i++)
+        {
+            if (cpus[i] >= lo && cpus[i] <= hi) nodes[i] = node;
+        }
+    }
+}
+
+int platform_cpu_topology(int *cpus, int *nodes, int max)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return 0;
+
+    int n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++)
+    {
+        if (!CPU_ISSET((size_t)cpu, &set)) continue;
+        cpus[n] = cpu;
+        nodes[n] = 0;
+        n++;
+    }
+
+    DIR *sys = opendir("/sys/devices/system/node");
+    if (!sys) return n;
+
+    struct dirent *e;
+    while ((e = readdir(sys)) != NULL)
+    {
+        int node;
+        char file[300];
+        if (sscanf(e->d_name, "node%d", &node) != 1) continue;
+        snprintf(file,
+                 sizeof(file),
+                 "/sys/devices/system/node/%s/cpulist",
+                 e->d_name);
+        read_node_cpus(file, node, cpus, nodes, n);
+    }
+    closedir(sys);
+    return n;
+}
+
+bool platform_pin_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET((size_t)cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+    #else
+// no portable way to pin threads (e.g. macOS only takes affinity hints)
+int platform_cpu_topology(int *cpus, int *nodes, int max)
+{
+    (void)cpus;
+    (void)nodes;
+    (void)max;
+    return 0;
+}
+
+bool platform_pin_thread(int cpu)
+{
+    (void)cpu;
+    return false;
+}
+    #endif
 #endif
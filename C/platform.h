@@ -2,18 +2,26 @@
 #define PLATFORM_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct
 {
     bool is_directory;
+    bool is_symlink; // only reported by platform_lstat
     uint64_t size_apparent;
     uint64_t size_allocated;
+    // identify a directory; 0 when unknown (always for platform_lstat on
+    // Windows, where finding out costs opening the directory)
+    uint64_t dev;
+    uint64_t ino;
 } platform_stat_t;
 
 typedef struct platform_dir platform_dir_t;
 
 bool platform_stat(const char *path, platform_stat_t *st);
+// like platform_stat, but a symlink describes the link, not its target
+bool platform_lstat(const char *path, platform_stat_t *st);
 bool platform_is_directory(const char *path);
 uint64_t platform_file_size(const char *path, bool apparent);
 
@@ -21,5 +29,108 @@ platform_dir_t *platform_opendir(const char *path);
 const char *platform_readdir(platform_dir_t *dir);
 void platform_closedir(platform_dir_t *dir);
 bool is_symlink(const char *path);
+// absolute path with links resolved, to be freed; NULL on failure
+char *platform_realpath(const char *path);
+
+// monotonic clock in seconds, for deadlines and rates
+double platform_time(void);
+void platform_sleep_ms(unsigned ms);
+// atomically replace `to` with `from` (both on the same filesystem)
+bool platform_replace_file(const char *from, const char *to);
+
+// helper threads outside the OpenMP team (e.g. background writers)
+typedef struct platform_thread platform_thread_t;
+typedef struct platform_mutex platform_mutex_t;
+
+platform_thread_t *platform_thread_start(void (*fn)(void *), void *arg);
+void platform_thread_join(platform_thread_t *thread);
+platform_mutex_t *platform_mutex_create(void);
+void platform_mutex_lock(platform_mutex_t *mutex);
+void platform_mutex_unlock(platform_mutex_t *mutex);
+void platform_mutex_free(platform_mutex_t *mutex);
+
+/*
+ * Named shared memory other processes can map. A new object is zero
+ * filled; an existing one is mapped as it is and *existed is set, so the
+ * caller can tell whether it may take it over. Closing it leaves the name
+ * in place on POSIX, where it lasts until it is unlinked; on Windows it
+ * goes away with the last handle to it.
+ */
+typedef struct platform_shm platform_shm_t;
+
+platform_shm_t *platform_shm_create(const char *name,
+                                    size_t size,
+                                    bool *existed);
+void *platform_shm_data(platform_shm_t *shm);
+void platform_shm_close(platform_shm_t *shm);
+
+uint64_t platform_pid(void);
+// true for a running process, even one we may not signal
+bool platform_process_alive(uint64_t pid);
+
+/*
+ * For memory shared with helper threads or other processes, which the
+ * OpenMP pragmas don't cover (they vanish when OpenMP is off). Loads
+ * acquire, stores release and the fence is a full barrier.
+ */
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+
+static inline uint64_t platform_atomic_load(uint64_t *p)
+{
+    return (uint64_t)_InterlockedOr64((volatile __int64 *)p, 0);
+}
+
+static inline void platform_atomic_store(uint64_t *p, uint64_t v)
+{
+    _InterlockedExchange64((volatile __int64 *)p, (__int64)v);
+}
+
+static inline bool platform_atomic_cas(uint64_t *p, uint64_t from, uint64_t to)
+{
+    return (uint64_t)_InterlockedCompareExchange64(
+             (volatile __int64 *)p, (__int64)to, (__int64)from) == from;
+}
+
+static inline void platform_fence(void)
+{
+    // interlocked operations are full barriers
+    volatile long fence = 0;
+    _InterlockedExchange(&fence, 1);
+}
+#else
+static inline uint64_t platform_atomic_load(uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void platform_atomic_store(uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline bool platform_atomic_cas(uint64_t *p, uint64_t from, uint64_t to)
+{
+    return __atomic_compare_exchange_n(
+      p, &from, to, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void platform_fence(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+#endif
+
+typedef enum
+{
+    AFFINITY_NONE = 0,
+    AFFINITY_COMPACT,
+    AFFINITY_SPREAD
+} affinity_t;
+
+// CPUs the process may run on and the NUMA node of each (0 when unknown);
+// returns how many were stored, 0 if pinning isn't supported
+int platform_cpu_topology(int *cpus, int *nodes, int max);
+bool platform_pin_thread(int cpu);
 
 #endif
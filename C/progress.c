@@ -0,0 +1,131 @@
+#include "progress.h"
+#include "platform.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RATE_WINDOW 1.0 // seconds
+
+struct progress
+{
+    platform_shm_t *shm;
+    progress_shared_t *shared;
+    double print_interval;
+    double next_print;
+    double started;
+    double rate_time; // start of the current rate window
+    uint64_t rate_entries;
+    uint64_t rate;
+};
+
+// a seqlock with a single writer; see progress_shared_t
+static void publish(progress_shared_t *shared, const progress_counters_t *c)
+{
+    uint64_t seq = platform_atomic_load(&shared->seq);
+    platform_atomic_store(&shared->seq, seq + 1);
+    platform_fence(); // the counters must not be seen before the odd seq
+    memcpy(&shared->counters, c, sizeof(*c));
+    platform_atomic_store(&shared->seq, seq + 2);
+}
+
+/*
+ * Claims the --shm segment by swapping our pid into it. A segment left by
+ * an earlier run is taken over; one whose writer is still running is left
+ * alone. A pid of 0 belongs to nobody, whether the segment was just
+ * created or its creator died before claiming it, and a segment of another
+ * version has no pid field to trust. Two runs starting at once race on the
+ * swap, and only one of them wins it.
+ */
+static progress_shared_t *claim_shared(progress_t *p, const char *name)
+{
+    bool existed = false;
+    p->shm = platform_shm_create(name, sizeof(progress_shared_t), &existed);
+    if (!p->shm)
+    {
+        fprintf(stderr, "Warning: cannot create shared memory '%s'\n", name);
+        return NULL;
+    }
+
+    progress_shared_t *shared = platform_shm_data(p->shm);
+    uint64_t self = platform_pid();
+    uint64_t holder = platform_atomic_load(&shared->pid);
+    bool stale = shared->magic == PROGRESS_MAGIC &&
+                 shared->version != PROGRESS_VERSION;
+    bool live = existed && !stale && holder != 0 && holder != self &&
+                platform_process_alive(holder);
+    if (live || !platform_atomic_cas(&shared->pid, holder, self))
+    {
+        fprintf(stderr,
+                "Warning: shared memory '%s' is in use by another udu\n",
+                name);
+        platform_shm_close(p->shm);
+        p->shm = NULL;
+        return NULL;
+    }
+
+    // a writer killed mid-update leaves seq odd
+    uint64_t seq = platform_atomic_load(&shared->seq);
+    if (seq & 1) platform_atomic_store(&shared->seq, seq + 1);
+    progress_counters_t zero = { 0 };
+    publish(shared, &zero);
+    shared->version = PROGRESS_VERSION;
+    shared->magic = PROGRESS_MAGIC;
+    return shared;
+}
+
+progress_t *progress_start(const char *shm_name, int print_interval)
+{
+    progress_t *p = calloc(1, sizeof(progress_t));
+    if (!p) return NULL;
+
+    if (shm_name) p->shared = claim_shared(p, shm_name);
+
+    p->started = platform_time();
+    p->rate_time = p->started;
+    p->print_interval = (double)print_interval;
+    p->next_print = p->started + p->print_interval;
+    return p;
+}
+
+void progress_update(progress_t *p, progress_counters_t *c)
+{
+    double now = platform_time();
+    uint64_t entries = c->files + c->dirs;
+    if (now - p->rate_time >= RATE_WINDOW)
+    {
+        uint64_t done = entries > p->rate_entries ? entries - p->rate_entries
+                                                  : 0;
+        p->rate = (uint64_t)((double)done / (now - p->rate_time));
+        p->rate_time = now;
+        p->rate_entries = entries;
+    }
+    c->rate = p->rate;
+    c->elapsed = now - p->started;
+
+    if (p->shared) publish(p->shared, c);
+
+    if (p->print_interval > 0 && now >= p->next_print && !c->finished)
+    {
+        char size_str[32];
+        fprintf(stderr,
+                "Progress: %s, %lu files, %lu directories, %lu/s, "
+                "%lu/%lu workers busy, %lu pending, %.0fs\n",
+                human_size(c->bytes, size_str, sizeof(size_str)),
+                c->files,
+                c->dirs,
+                c->rate,
+                c->active_workers,
+                c->workers,
+                c->pending_dirs,
+                c->elapsed);
+        p->next_print = now + p->print_interval;
+    }
+}
+
+void progress_stop(progress_t *p)
+{
+    if (!p) return;
+    platform_shm_close(p->shm); // the final counters stay readable
+    free(p);
+}
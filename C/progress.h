@@ -0,0 +1,48 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROGRESS_MAGIC 0x31756475u // "udu1" in little endian
+#define PROGRESS_VERSION 2
+#define PROGRESS_DEFAULT_INTERVAL 5 // seconds
+
+typedef struct
+{
+    uint64_t bytes;
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t rate;           // files and directories per second
+    uint64_t workers;
+    uint64_t active_workers; // reading a directory right now
+    uint64_t pending_dirs;   // found but not finished yet
+    double elapsed;          // seconds since the walk started
+    uint64_t finished;       // 1 once the counters are final
+} progress_counters_t;
+
+/*
+ * Layout of the --shm segment. seq is odd while an update is being
+ * written: a monitor copies the counters, then retries if seq was odd or
+ * changed in the meantime. Nothing is written when the walk is idle, so
+ * polling costs udu nothing. The segment outlives the scan with its final
+ * counters; pid tells a later run whether it may take the name over.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;
+    progress_counters_t counters;
+    uint64_t pid; // of the udu writing it
+} progress_shared_t;
+
+typedef struct progress progress_t;
+
+// NULL shm_name publishes nothing, print_interval 0 prints nothing
+progress_t *progress_start(const char *shm_name, int print_interval);
+// fills in rate and elapsed, then publishes and prints as due
+void progress_update(progress_t *p, progress_counters_t *c);
+void progress_stop(progress_t *p);
+
+#endif
@@ -0,0 +1,279 @@
+#include "record.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#define INITIAL_RECORDS 1024
+#define INITIAL_NAMES (64 * 1024)
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define OUTPUT_BUFFER (256 * 1024)
+
+static inline int team_size(void)
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static inline int team_index(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+bool record_buf_push(record_buf_t *buf, uint64_t size, const char *name)
+{
+    size_t len = strlen(name) + 1;
+
+    if (buf->count >= buf->capacity)
+    {
+        size_t cap = buf->capacity ? buf->capacity * 2 : INITIAL_RECORDS;
+        record_t *grown = realloc(buf->items, cap * sizeof(record_t));
+        if (!grown) return false;
+        buf->items = grown;
+        buf->capacity = cap;
+    }
+
+    if (buf->names_len + len > buf->names_capacity)
+    {
+        size_t cap = buf->names_capacity ? buf->names_capacity : INITIAL_NAMES;
+        while (cap < buf->names_len + len) cap *= 2;
+        char *grown = realloc(buf->names, cap);
+        if (!grown) return false;
+        buf->names = grown;
+        buf->names_capacity = cap;
+    }
+
+    memcpy(buf->names + buf->names_len, name, len);
+    buf->items[buf->count].size = size;
+    buf->items[buf->count].name.offset = buf->names_len;
+    buf->count++;
+    buf->names_len += len;
+    return true;
+}
+
+void record_buf_free(record_buf_t *buf)
+{
+    free(buf->items);
+    free(buf->names);
+    memset(buf, 0, sizeof(*buf));
+}
+
+/*
+ * Parallel LSD radix sort on the 64-bit sizes. Every pass each thread
+ * counts digits of its own slice, the counts are turned into per-thread
+ * scatter offsets (digit major, thread minor, which keeps it stable), and
+ * the slices are scattered concurrently. Passes where all keys share the
+ * same digit are skipped, so small sizes only pay for their low bytes.
+ * Returns whichever of the two arrays holds the result.
+ */
+static record_t *radix_sort_size(record_t *src, record_t *tmp, size_t n)
+{
+    int threads = team_size();
+    size_t(*hist)[RADIX_BUCKETS] = calloc((size_t)threads, sizeof(*hist));
+    if (!hist) return NULL;
+
+    for (unsigned shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        bool skip = false;
+
+#pragma omp parallel num_threads(threads)
+        {
+            size_t t = (size_t)team_index();
+#ifdef _OPENMP
+            size_t nt = (size_t)omp_get_num_threads();
+#else
+            size_t nt = 1;
+#endif
+            size_t lo = n * t / nt;
+            size_t hi = n * (t + 1) / nt;
+            size_t *h = hist[t];
+
+            memset(h, 0, sizeof(*hist));
+            for (size_t i = lo; i < hi; i++)
+            {
+                h[(src[i].size >> shift) & (RADIX_BUCKETS - 1)]++;
+            }
+
+#pragma omp barrier
+#pragma omp single
+            {
+                size_t offset = 0;
+                for (size_t d = 0; d < RADIX_BUCKETS; d++)
+                {
+                    size_t digit_total = 0;
+                    for (size_t k = 0; k < nt; k++)
+                    {
+                        size_t c = hist[k][d];
+                        hist[k][d] = offset;
+                        offset += c;
+                        digit_total += c;
+                    }
+                    if (digit_total == n) skip = true;
+                }
+            }
+
+            if (!skip)
+            {
+                for (size_t i = lo; i < hi; i++)
+                {
+                    size_t d = (src[i].size >> shift) & (RADIX_BUCKETS - 1);
+                    tmp[h[d]++] = src[i];
+                }
+            }
+        }
+
+        if (!skip)
+        {
+            record_t *swap = src;
+            src = tmp;
+            tmp = swap;
+        }
+    }
+
+    free(hist);
+    return src;
+}
+
+static int compare_name(const void *a, const void *b)
+{
+    return strcmp(((const record_t *)a)->name.ptr,
+                  ((const record_t *)b)->name.ptr);
+}
+
+static void merge_runs(const record_t *src,
+                       record_t *dst,
+                       size_t lo,
+                       size_t mid,
+                       size_t hi)
+{
+    size_t i = lo, j = mid, k = lo;
+    while (i < mid && j < hi)
+    {
+        dst[k++] = compare_name(&src[j], &src[i]) < 0 ? src[j++] : src[i++];
+    }
+    while (i < mid) dst[k++] = src[i++];
+    while (j < hi) dst[k++] = src[j++];
+}
+
+/*
+ * Parallel merge sort on names: one run per thread is sorted with qsort,
+ * then neighbouring runs are merged pairwise, each round in parallel.
+ */
+static record_t *merge_sort_name(record_t *src, record_t *tmp, size_t n)
+{
+    size_t runs = (size_t)team_size();
+    if (runs > n) runs = n ? n : 1;
+    size_t run = (n + runs - 1) / runs;
+    if (run == 0) return src;
+
+    long chunks = (long)((n + run - 1) / run);
+#pragma omp parallel for schedule(static)
+    for (long c = 0; c < chunks; c++)
+    {
+        size_t lo = (size_t)c * run;
+        size_t hi = lo + run < n ? lo + run : n;
+        qsort(src + lo, hi - lo, sizeof(record_t), compare_name);
+    }
+
+    for (size_t width = run; width < n; width *= 2)
+    {
+        long pairs = (long)((n + 2 * width - 1) / (2 * width));
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long p = 0; p < pairs; p++)
+        {
+            size_t lo = (size_t)p * 2 * width;
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            merge_runs(src, tmp, lo, mid, hi);
+        }
+        record_t *swap = src;
+        src = tmp;
+        tmp = swap;
+    }
+
+    return src;
+}
+
+static void write_records(const record_t *items, size_t n)
+{
+    char *out = malloc(OUTPUT_BUFFER);
+    size_t used = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        char size_str[32];
+        char line[64];
+        human_size(items[i].size, size_str, sizeof(size_str));
+        int len = snprintf(line, sizeof(line), "%-8s ", size_str);
+        size_t name_len = strlen(items[i].name.ptr);
+        size_t need = (size_t)len + name_len + 1;
+
+        // records too big for the buffer (or no buffer at all) go direct
+        if (!out || need > OUTPUT_BUFFER)
+        {
+            printf("%s%s\n", line, items[i].name.ptr);
+            continue;
+        }
+        if (used + need > OUTPUT_BUFFER)
+        {
+            fwrite(out, 1, used, stdout);
+            used = 0;
+        }
+        memcpy(out + used, line, (size_t)len);
+        memcpy(out + used + (size_t)len, items[i].name.ptr, name_len);
+        out[used + need - 1] = '\n';
+        used += need;
+    }
+
+    if (out)
+    {
+        fwrite(out, 1, used, stdout);
+        free(out);
+    }
+}
+
+bool records_print_sorted(record_buf_t *bufs, int count, sort_key_t key)
+{
+    size_t n = 0;
+    for (int i = 0; i < count; i++) n += bufs[i].count;
+    if (n == 0) return true;
+
+    record_t *all = malloc(n * sizeof(record_t));
+    record_t *tmp = malloc(n * sizeof(record_t));
+    if (!all || !tmp)
+    {
+        free(all);
+        free(tmp);
+        return false;
+    }
+
+    // gather, turning arena offsets into pointers now that arenas are final
+    size_t k = 0;
+    for (int i = 0; i < count; i++)
+    {
+        for (size_t j = 0; j < bufs[i].count; j++, k++)
+        {
+            all[k].size = bufs[i].items[j].size;
+            all[k].name.ptr = bufs[i].names + bufs[i].items[j].name.offset;
+        }
+    }
+
+    const record_t *sorted = key == SORT_NAME ? merge_sort_name(all, tmp, n)
+                                              : radix_sort_size(all, tmp, n);
+    if (sorted) write_records(sorted, n);
+
+    free(all);
+    free(tmp);
+    return sorted != NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    SORT_NONE = 0,
+    SORT_SIZE,
+    SORT_NAME
+} sort_key_t;
+
+/*
+ * Fixed size output record. While a worker is appending, the name is an
+ * offset into the owning buffer's name arena; it is resolved to a pointer
+ * when buffers are gathered for sorting.
+ */
+typedef struct
+{
+    uint64_t size;
+    union
+    {
+        size_t offset;
+        const char *ptr;
+    } name;
+} record_t;
+
+// per-thread, append only
+typedef struct
+{
+    record_t *items;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_len;
+    size_t names_capacity;
+} record_buf_t;
+
+bool record_buf_push(record_buf_t *buf, uint64_t size, const char *name);
+void record_buf_free(record_buf_t *buf);
+
+// sorts the records of all buffers together and writes them to stdout
+bool records_print_sorted(record_buf_t *bufs, int count, sort_key_t key);
+
+#endif
@@ -0,0 +1,588 @@
+#include "serve.h"
+#include "index.h"
+#include "platform.h"
+#include "walk.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+
+int serve_run(const args_t *args)
+{
+    (void)args;
+    fprintf(stderr, "Error: serve is not supported on this platform\n");
+    return 1;
+}
+
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <inttypes.h>
+    #include <limits.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <stdarg.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+
+    #define SERVE_READERS 8
+    #define SERVE_BACKLOG 64
+    #define SERVE_MAX_TOP 1000
+    #define SERVE_POLL_MS 100
+    #define SERVE_CLIENTS 64        // connections polled by one reader
+    #define SERVE_LINE_MAX (PATH_MAX + 32)
+    #define SERVE_OUT_HIGH (64 * 1024) // queued reply bytes per client
+    #define SERVE_SOCKET_MODE 0600
+
+/*
+ * Readers never lock. The index in use is slots[generation & 1]; a reader
+ * registers in readers[] under the generation it saw and re-checks that
+ * the generation did not move before touching the slot. The scanner
+ * publishes a new index into the other slot, bumps the generation, then
+ * waits for the old generation's readers to drain before freeing it.
+ */
+typedef struct
+{
+    int listen_fd;
+    dir_index_t *slots[2];
+    unsigned generation;
+    unsigned readers[2];
+} server_t;
+
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+} reply_t;
+
+// a connection, the start of its next request line and the replies not
+// written to it yet
+typedef struct
+{
+    int fd;
+    bool eof; // no more requests; closed once everything is answered
+    size_t len;
+    reply_t out;
+    size_t sent; // out.buf[sent, out.len) is still to be written
+    char line[SERVE_LINE_MAX];
+} client_t;
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static unsigned reader_enter(server_t *s)
+{
+    for (;;)
+    {
+        unsigned g = __atomic_load_n(&s->generation, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&s->readers[g & 1], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&s->generation, __ATOMIC_SEQ_CST) == g) return g;
+        // raced with a publish; the slot may already be retired
+        __atomic_fetch_sub(&s->readers[g & 1], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void reader_leave(server_t *s, unsigned g)
+{
+    __atomic_fetch_sub(&s->readers[g & 1], 1, __ATOMIC_SEQ_CST);
+}
+
+// only ever called from the scanning thread
+static void publish(server_t *s, dir_index_t *index)
+{
+    unsigned g = __atomic_load_n(&s->generation, __ATOMIC_SEQ_CST);
+    s->slots[(g + 1) & 1] = index; // drained by the previous publish
+    __atomic_store_n(&s->generation, g + 1, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(&s->readers[g & 1], __ATOMIC_SEQ_CST) != 0)
+    {
+        platform_sleep_ms(1);
+    }
+    index_free(s->slots[g & 1]);
+    s->slots[g & 1] = NULL;
+}
+
+__attribute__((format(printf, 2, 3))) static void
+reply_printf(reply_t *r, const char *fmt, ...)
+{
+    for (;;)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = r->buf ? vsnprintf(r->buf + r->len, r->cap - r->len, fmt, ap)
+                       : -1;
+        va_end(ap);
+
+        if (n >= 0 && (size_t)n < r->cap - r->len)
+        {
+            r->len += (size_t)n;
+            return;
+        }
+
+        size_t cap = r->cap ? r->cap * 2 : 4096;
+        size_t need = n >= 0 ? r->len + (size_t)n + 1 : 0;
+        if (cap < need) cap = need;
+        char *grown = realloc(r->buf, cap);
+        if (!grown) return; // the client sees a truncated reply
+        r->buf = grown;
+        r->cap = cap;
+    }
+}
+
+static void reply_entry(reply_t *r, const index_entry_t *e, bool with_path)
+{
+    reply_printf(r,
+                 "%" PRIu64 " %" PRIu64 " %" PRIu64 "%s%s\n",
+                 e->size,
+                 e->files,
+                 e->dirs,
+                 with_path ? " " : "",
+                 with_path ? e->path : "");
+}
+
+/*
+ * Looks path up as sent first, which is the fast path for clients that
+ * send the canonical form, then resolved by realpath. Answers under the
+ * reader section; the slot must not be touched after leaving it.
+ */
+static void answer_path(server_t *s, const char *path, size_t top, reply_t *r)
+{
+    char resolved[PATH_MAX];
+    const char *attempts[2] = { path, NULL };
+    const index_entry_t **best = NULL;
+
+    if (top)
+    {
+        best = malloc(top * sizeof(*best));
+        if (!best)
+        {
+            reply_printf(r, "ERR out of memory\n");
+            return;
+        }
+    }
+
+    for (int a = 0; a < 2; a++)
+    {
+        if (a == 1)
+        {
+            if (!realpath(path, resolved) || strcmp(resolved, path) == 0)
+            {
+                break;
+            }
+            attempts[1] = resolved;
+        }
+
+        unsigned g = reader_enter(s);
+        const dir_index_t *index = s->slots[g & 1];
+        const index_entry_t *e = index ? index_find(index, attempts[a])
+                                       : NULL;
+        if (!index)
+        {
+            reply_printf(r, "ERR not ready\n");
+        }
+        else if (e && top)
+        {
+            size_t n = index_top(index, e, best, top);
+            reply_printf(r, "OK %lu\n", (unsigned long)n);
+            for (size_t i = 0; i < n; i++) reply_entry(r, best[i], true);
+        }
+        else if (e)
+        {
+            reply_printf(r, "OK ");
+            reply_entry(r, e, false);
+        }
+        reader_leave(s, g);
+
+        if (!index || e)
+        {
+            free(best);
+            return;
+        }
+    }
+
+    free(best);
+    reply_printf(r, "ERR not found\n");
+}
+
+static void answer_info(server_t *s, reply_t *r)
+{
+    unsigned g = reader_enter(s);
+    const dir_index_t *index = s->slots[g & 1];
+    if (index)
+    {
+        reply_printf(r,
+                     "OK generation %u age %.0f directories %lu\n",
+                     g,
+                     platform_time() - index->built,
+                     (unsigned long)index->count);
+    }
+    else
+    {
+        reply_printf(r, "ERR not ready\n");
+    }
+    reader_leave(s, g);
+}
+
+// strips trailing separators, but keeps a lone "/"
+static void trim_path(char *path)
+{
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') path[--len] = '\0';
+}
+
+static void answer(server_t *s, char *line, reply_t *r)
+{
+    char *arg = strchr(line, ' ');
+    if (arg) *arg++ = '\0';
+
+    if (strcmp(line, "size") == 0 && arg && *arg)
+    {
+        trim_path(arg);
+        answer_path(s, arg, 0, r);
+    }
+    else if (strcmp(line, "top") == 0 && arg)
+    {
+        char *path = NULL;
+        unsigned long n = strtoul(arg, &path, 10);
+        if (path == arg || *path != ' ' || n == 0 || path[1] == '\0')
+        {
+            reply_printf(r, "ERR usage: top N PATH\n");
+            return;
+        }
+        if (n > SERVE_MAX_TOP) n = SERVE_MAX_TOP;
+        path++;
+        trim_path(path);
+        answer_path(s, path, (size_t)n, r);
+    }
+    else if (strcmp(line, "info") == 0 && !arg)
+    {
+        answer_info(s, r);
+    }
+    else
+    {
+        reply_printf(r, "ERR unknown request\n");
+    }
+}
+
+static bool has_line(const client_t *c)
+{
+    return memchr(c->line, '\n', c->len) || (c->eof && c->len);
+}
+
+/*
+ * Queues the answers to the complete lines in c->line. It stops once
+ * SERVE_OUT_HIGH bytes are queued, so a client pipelining requests without
+ * reading the replies holds at most that much; the rest of its lines wait.
+ */
+static void serve_lines(server_t *s, client_t *c)
+{
+    char *start = c->line;
+    char *end = c->line + c->len;
+    while (start < end && c->out.len < SERVE_OUT_HIGH)
+    {
+        char *nl = memchr(start, '\n', (size_t)(end - start));
+        if (!nl && !c->eof) break;
+
+        char *stop = nl ? nl : end; // a last line may lack its newline
+        while (stop > start && stop[-1] == '\r') stop--;
+        *stop = '\0';
+        answer(s, start, &c->out);
+        start = nl ? nl + 1 : end;
+    }
+
+    c->len = (size_t)(end - start);
+    memmove(c->line, start, c->len);
+    if (c->len == sizeof(c->line) - 1 && !has_line(c))
+    {
+        reply_printf(&c->out, "ERR request too long\n");
+        c->len = 0;
+        c->eof = true;
+    }
+}
+
+// writes what the socket takes now; false once the client is gone
+static bool flush_client(client_t *c)
+{
+    while (c->sent < c->out.len)
+    {
+        ssize_t n = write(c->fd, c->out.buf + c->sent, c->out.len - c->sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n <= 0) return false;
+        c->sent += (size_t)n;
+    }
+
+    c->out.len = 0;
+    c->sent = 0;
+    // a big top reply doesn't stay allocated for the life of the connection
+    if (c->out.cap > SERVE_OUT_HIGH)
+    {
+        free(c->out.buf);
+        memset(&c->out, 0, sizeof(c->out));
+    }
+    return true;
+}
+
+/*
+ * Reads what the client sent, if poll said it can, and answers and writes
+ * as far as the socket allows; false once the client is done. A client
+ * with replies pending is only polled for writing, so it is not read from
+ * again until it has taken them.
+ */
+static bool serve_client(server_t *s, client_t *c, short revents)
+{
+    if ((revents & (POLLIN | POLLHUP | POLLERR)) && !c->eof && !c->out.len)
+    {
+        ssize_t n =
+          read(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len);
+        if (n < 0 && errno != EINTR && errno != EAGAIN) return false;
+        if (n == 0) c->eof = true;
+        if (n > 0) c->len += (size_t)n;
+    }
+
+    do
+    {
+        serve_lines(s, c);
+        if (!flush_client(c)) return false;
+    } while (!c->out.len && has_line(c));
+
+    return !c->eof || c->out.len;
+}
+
+static void client_free(client_t *c)
+{
+    close(c->fd);
+    free(c->out.buf);
+    free(c);
+}
+
+static client_t *accept_client(int listen_fd)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return NULL;
+
+    // a client that stops reading must not hold up everyone else polled
+    // by this reader, so its replies are queued rather than waited for
+    int flags = fcntl(fd, F_GETFL);
+    client_t *c = calloc(1, sizeof(client_t));
+    if (!c || flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+    {
+        free(c);
+        close(fd);
+        return NULL;
+    }
+    c->fd = fd;
+    return c;
+}
+
+/*
+ * Each reader polls the listening socket and up to SERVE_CLIENTS
+ * connections, so idle clients cost a slot but never a thread. The
+ * listening socket is non-blocking: every reader wakes for a new
+ * connection and the ones that lose the race to accept it get EAGAIN.
+ */
+static void reader_main(void *arg)
+{
+    server_t *s = arg;
+    client_t *clients[SERVE_CLIENTS];
+    struct pollfd fds[SERVE_CLIENTS + 1];
+    int count = 0;
+
+    for (;;)
+    {
+        // a full reader leaves new connections to the others
+        fds[0].fd = count < SERVE_CLIENTS ? s->listen_fd : -1;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < count; i++)
+        {
+            fds[i + 1].fd = clients[i]->fd;
+            fds[i + 1].events = clients[i]->out.len ? POLLOUT : POLLIN;
+        }
+
+        if (poll(fds, (nfds_t)count + 1, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = count - 1; i >= 0; i--)
+        {
+            if (!fds[i + 1].revents ||
+                serve_client(s, clients[i], fds[i + 1].revents))
+            {
+                continue;
+            }
+            client_free(clients[i]);
+            clients[i] = clients[--count];
+        }
+
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            break; // listening socket shut down
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            client_t *c = accept_client(s->listen_fd);
+            if (c) clients[count++] = c;
+        }
+    }
+
+    for (int i = 0; i < count; i++) client_free(clients[i]);
+}
+
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: socket path '%s' is too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot create socket\n");
+        return -1;
+    }
+
+    // a leftover socket file is replaced, a live server is not
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        fprintf(stderr, "Error: '%s' is already being served\n", path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    unlink(path);
+
+    // nobody can connect before listen, so the mode is set in time
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int flags = fd >= 0 ? fcntl(fd, F_GETFL) : -1;
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        chmod(path, SERVE_SOCKET_MODE) != 0 ||
+        listen(fd, SERVE_BACKLOG) != 0)
+    {
+        fprintf(stderr, "Error: cannot listen on '%s'\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void install_signals(void)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    // a second signal kills a server stuck in a long scan
+    sa.sa_handler = on_signal;
+    sa.sa_flags = (int)(SA_RESTART | SA_RESETHAND);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+static void wait_for_rescan(int rescan)
+{
+    double next = platform_time() + (double)rescan;
+    while (!stop_requested && (rescan == 0 || platform_time() < next))
+    {
+        platform_sleep_ms(SERVE_POLL_MS);
+    }
+}
+
+static void free_roots(char **roots, int count)
+{
+    for (int i = 0; i < count; i++) free(roots[i]);
+    free(roots);
+}
+
+int serve_run(const args_t *args)
+{
+    // queries are resolved with realpath, so the roots must be canonical
+    char **roots = calloc((size_t)args->path_count, sizeof(char *));
+    for (int i = 0; roots && i < args->path_count; i++)
+    {
+        roots[i] = realpath(args->paths[i], NULL);
+        if (!roots[i])
+        {
+            fprintf(stderr, "Error: cannot resolve '%s'\n", args->paths[i]);
+            free_roots(roots, args->path_count);
+            return 1;
+        }
+    }
+    if (!roots)
+    {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    args_t scan = *args;
+    scan.paths = roots;
+    scan.index = true;
+    scan.verbose = false;
+    scan.quiet = true;
+    scan.by_ext = false;
+    scan.sort = SORT_NONE;
+
+    // readers may still run while the process exits, so not on the stack
+    static server_t s;
+    s.listen_fd = listen_unix(args->socket);
+    if (s.listen_fd < 0)
+    {
+        free_roots(roots, args->path_count);
+        return 1;
+    }
+
+    install_signals();
+    for (int i = 0; i < SERVE_READERS; i++)
+    {
+        if (!platform_thread_start(reader_main, &s))
+        {
+            fprintf(stderr, "Warning: only %d reader threads\n", i);
+            break;
+        }
+    }
+
+    while (!stop_requested)
+    {
+        double start = platform_time();
+        walk_result_t result = walk_paths(&scan);
+        if (result.index)
+        {
+            fprintf(stderr,
+                    "Indexed %lu directories in %.2fs\n",
+                    (unsigned long)result.index->count,
+                    platform_time() - start);
+            publish(&s, result.index);
+            result.index = NULL;
+        }
+        walk_result_free(&result);
+        wait_for_rescan(args->rescan);
+    }
+
+    // readers polling the socket fail out; the process exit ends the rest
+    shutdown(s.listen_fd, SHUT_RDWR);
+    close(s.listen_fd);
+    unlink(args->socket);
+    free_roots(roots, args->path_count);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "args.h"
+
+#define SERVE_DEFAULT_RESCAN 600 // seconds
+
+/*
+ * Resident mode: scans the roots, keeps per-directory totals in memory and
+ * answers queries on a Unix domain socket, one request per line:
+ *
+ *   size PATH      OK <bytes> <files> <dirs>
+ *   top N PATH     OK <count>, then <bytes> <files> <dirs> <path> per line
+ *   info           OK generation <g> age <secs> directories <n>
+ *
+ * Failures are answered with "ERR <reason>". The roots are rescanned every
+ * args->rescan seconds (never if 0) while queries keep being answered from
+ * the previous scan. Runs until SIGINT or SIGTERM.
+ */
+int serve_run(const args_t *args);
+
+#endif
@@ -0,0 +1,113 @@
+#include "shim.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct
+{
+    const char *name;
+    const char *env;
+    long delay_us;
+    uint64_t calls;
+    uint64_t delayed_ns;
+} shim_stat_t;
+
+static shim_stat_t stats[SHIM_OP_COUNT] = {
+    [SHIM_STAT] = { "stat", "UDU_SHIM_STAT_US", 0, 0, 0 },
+    [SHIM_LSTAT] = { "lstat", "UDU_SHIM_STAT_US", 0, 0, 0 },
+    [SHIM_OPENDIR] = { "opendir", "UDU_SHIM_OPENDIR_US", 0, 0, 0 },
+    [SHIM_READDIR] = { "readdir", "UDU_SHIM_READDIR_US", 0, 0, 0 },
+};
+
+static long jitter_us;
+static unsigned long readdir_batch = 1;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static __thread uint64_t rng;
+
+static long env_long(const char *name, long fallback)
+{
+    const char *value = getenv(name);
+    if (!value || !*value) return fallback;
+
+    char *end = NULL;
+    long n = strtol(value, &end, 10);
+    return (*end == '\0' && n >= 0) ? n : fallback;
+}
+
+static void report(void)
+{
+    fprintf(stderr, "shim:");
+    for (int i = 0; i < SHIM_OP_COUNT; i++)
+    {
+        fprintf(stderr,
+                " %s=%lu (%.3fs)",
+                stats[i].name,
+                stats[i].calls,
+                (double)stats[i].delayed_ns / 1e9);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void init(void)
+{
+    for (int i = 0; i < SHIM_OP_COUNT; i++)
+    {
+        stats[i].delay_us = env_long(stats[i].env, 0);
+    }
+    jitter_us = env_long("UDU_SHIM_JITTER_US", 0);
+    long batch = env_long("UDU_SHIM_READDIR_BATCH", 1);
+    readdir_batch = batch > 0 ? (unsigned long)batch : 1;
+    atexit(report);
+}
+
+// xorshift64; seeded from the thread's stack address
+static uint64_t next_random(void)
+{
+    if (!rng) rng = (uint64_t)(uintptr_t)&rng | 1;
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void delay(shim_stat_t *s)
+{
+    long us = s->delay_us;
+    if (us == 0) return;
+    if (jitter_us > 0)
+    {
+        uint64_t span = (uint64_t)(2 * jitter_us + 1);
+        us += (long)(next_random() % span) - jitter_us;
+    }
+    if (us <= 0) return;
+
+    struct timespec ts = { .tv_sec = us / 1000000,
+                           .tv_nsec = (us % 1000000) * 1000 };
+    // resume if interrupted by a signal
+    while (nanosleep(&ts, &ts) != 0) continue;
+
+#pragma omp atomic
+    s->delayed_ns += (uint64_t)us * 1000;
+}
+
+void shim_hook(shim_op_t op)
+{
+    pthread_once(&once, init);
+
+#pragma omp atomic
+    stats[op].calls++;
+    delay(&stats[op]);
+}
+
+void shim_readdir(unsigned long index)
+{
+    pthread_once(&once, init);
+
+#pragma omp atomic
+    stats[SHIM_READDIR].calls++;
+    // the first entry of every batch pays for the getdents round trip
+    if (index % readdir_batch == 0) delay(&stats[SHIM_READDIR]);
+}
@@ -0,0 +1,39 @@
+#ifndef SHIM_H
+#define SHIM_H
+
+/*
+ * Latency injection for benchmarking network filesystem behavior on a
+ * local disk. Only compiled in with -DENABLE_LATENCY_SHIM=ON; otherwise
+ * SHIM_HOOK expands to nothing. Configured through the environment:
+ *
+ *   UDU_SHIM_STAT_US       delay per stat/lstat call
+ *   UDU_SHIM_OPENDIR_US    delay per opendir call
+ *   UDU_SHIM_READDIR_US    delay per readdir batch
+ *   UDU_SHIM_READDIR_BATCH entries per readdir batch, mimics getdents
+ *                          (default 1: every readdir call is delayed)
+ *   UDU_SHIM_JITTER_US     uniform +/- jitter added to every delay
+ *
+ * Call counts and injected time are reported on stderr at exit.
+ */
+
+typedef enum
+{
+    SHIM_STAT = 0,
+    SHIM_LSTAT,
+    SHIM_OPENDIR,
+    SHIM_READDIR,
+    SHIM_OP_COUNT
+} shim_op_t;
+
+#ifdef UDU_LATENCY_SHIM
+void shim_hook(shim_op_t op);
+void shim_readdir(unsigned long index);
+    #define SHIM_HOOK(op) shim_hook(op)
+    // index of the entry within its directory, for batching
+    #define SHIM_READDIR(index) shim_readdir(index)
+#else
+    #define SHIM_HOOK(op) ((void)0)
+    #define SHIM_READDIR(index) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+#include "throttle.h"
+#include "platform.h"
+
+#if defined(_MSC_VER)
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL __thread
+#endif
+
+#define REFILLS_PER_SEC 500.0 // target rate of batch refills, all threads
+#define MAX_BATCH 64
+#define BURST 0.01 // seconds of tokens an idle bucket may bank
+#define INITIAL_IOPS 1000.0 // latency mode without --max-iops
+#define MIN_IOPS 10.0
+#define ADJUST_INTERVAL 0.1 // seconds
+#define DECREASE 0.7
+#define INCREASE 1.05
+#define FAST_INCREASE 1.25 // while under half the target
+
+throttle_mode_t throttle_mode = THROTTLE_OFF;
+
+// shared, only touched inside the throttle critical section
+static double rate;       // tokens per second
+static double max_rate;   // 0 when unbounded (latency mode only)
+static double target;     // seconds
+static double next_token; // when the next unclaimed token is due
+static double next_adjust;
+static double latency_sum;
+static unsigned long latency_count;
+
+static THREAD_LOCAL unsigned cached;
+static THREAD_LOCAL double local_sum;
+static THREAD_LOCAL unsigned long local_count;
+
+void throttle_configure(uint64_t max_iops, uint64_t latency_target_us)
+{
+    max_rate = (double)max_iops;
+    target = (double)latency_target_us / 1e6;
+    rate = max_iops ? max_rate : INITIAL_IOPS;
+    if (latency_target_us && rate > INITIAL_IOPS) rate = INITIAL_IOPS;
+    next_token = platform_time();
+    next_adjust = next_token + ADJUST_INTERVAL;
+
+    throttle_mode = latency_target_us ? THROTTLE_LATENCY
+                    : max_iops        ? THROTTLE_RATE
+                                      : THROTTLE_OFF;
+}
+
+// multiplicative decrease above the target, gentle increase below it
+static void adjust(double now)
+{
+    latency_sum += local_sum;
+    latency_count += local_count;
+    local_sum = 0;
+    local_count = 0;
+
+    if (now < next_adjust || latency_count == 0) return;
+
+    double mean = latency_sum / (double)latency_count;
+    rate *= mean > target         ? DECREASE
+            : mean < target / 2 ? FAST_INCREASE
+                                : INCREASE;
+    if (rate < MIN_IOPS) rate = MIN_IOPS;
+    if (max_rate > 0 && rate > max_rate) rate = max_rate;
+
+    latency_sum = 0;
+    latency_count = 0;
+    next_adjust = now + ADJUST_INTERVAL;
+}
+
+/*
+ * Claims the next batch of tokens on the shared schedule and returns how
+ * long to wait for its first one. The schedule is absolute, so a thread
+ * that oversleeps is caught up by later refills, up to BURST.
+ */
+static double refill(void)
+{
+    double wait;
+#pragma omp critical(throttle)
+    {
+        double now = platform_time();
+        if (throttle_mode == THROTTLE_LATENCY) adjust(now);
+
+        double batch = rate / REFILLS_PER_SEC;
+        if (batch < 1) batch = 1;
+        if (batch > MAX_BATCH) batch = MAX_BATCH;
+
+        if (next_token < now - BURST) next_token = now - BURST;
+        wait = next_token - now;
+        next_token += batch / rate;
+        cached = (unsigned)batch;
+    }
+    return wait;
+}
+
+double throttle_wait(void)
+{
+    if (cached == 0)
+    {
+        double wait = refill();
+        unsigned ms = wait > 0 ? (unsigned)(wait * 1000.0 + 0.5) : 0;
+        if (ms > 0) platform_sleep_ms(ms);
+    }
+    cached--;
+    return throttle_mode == THROTTLE_LATENCY ? platform_time() : 0.0;
+}
+
+void throttle_record(double start)
+{
+    local_sum += platform_time() - start;
+    local_count++;
+}
+
+double throttle_rate(void)
+{
+    double r;
+#pragma omp critical(throttle)
+    r = rate;
+    return r;
+}
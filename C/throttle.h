@@ -0,0 +1,62 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <stdint.h>
+
+/*
+ * Rate limit for metadata calls (stat, lstat, opendir and the directory
+ * reads that follow), so a scan can share storage with production load.
+ * One token bucket is shared by all threads; each thread takes tokens in
+ * small batches and spends them locally, so the bucket's lock is taken a
+ * few hundred times a second at most, whatever the rate.
+ *
+ * With a latency target the rate is adjusted every 100ms: cut when the
+ * mean latency of the calls was over the target, raised again while it
+ * stays under (up to max_iops, if one is set).
+ */
+typedef enum
+{
+    THROTTLE_OFF = 0,
+    THROTTLE_RATE,
+    THROTTLE_LATENCY
+} throttle_mode_t;
+
+extern throttle_mode_t throttle_mode;
+
+// both 0 leaves throttling off; set before any worker starts
+void throttle_configure(uint64_t max_iops, uint64_t latency_target_us);
+
+// takes a token, sleeping until one is due; returns the time to measure
+// the call from (latency mode only)
+double throttle_wait(void);
+void throttle_record(double start);
+// the current rate, for reporting
+double throttle_rate(void);
+
+static inline double throttle_begin(void)
+{
+    return throttle_mode != THROTTLE_OFF ? throttle_wait() : 0.0;
+}
+
+static inline void throttle_end(double start)
+{
+    if (throttle_mode == THROTTLE_LATENCY) throttle_record(start);
+}
+
+/*
+ * Directory reads come from a libc or kernel buffer; only every
+ * THROTTLE_READDIR_BATCH'th entry stands for a real call (getdents). The
+ * first batch is paid for by opendir.
+ */
+#define THROTTLE_READDIR_BATCH 64
+
+static inline void throttle_readdir(unsigned long index)
+{
+    if (throttle_mode != THROTTLE_OFF && index > 0 &&
+        index % THROTTLE_READDIR_BATCH == 0)
+    {
+        throttle_wait();
+    }
+}
+
+#endif
@@ -79,6 +79,21 @@ bool glob_match(const char *pattern, const char *text)
     return pattern && text && glob_match_impl(UC(pattern), UC(text));
 }
 
+bool glob_match_any(char **patterns,
+                    int count,
+                    const char *name,
+                    const char *fullpath)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (glob_match(patterns[i], name) || glob_match(patterns[i], fullpath))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 char *path_join(const char *parent, const char *child)
 {
     if (!parent || !child) return NULL;
@@ -113,6 +128,125 @@ char *path_join(const char *parent, const char *child)
     return out;
 }
 
+bool path_buf_init(path_buf_t *pb, const char *parent)
+{
+    size_t plen = strlen(parent);
+
+#ifdef _WIN32
+    const char sep = '\\';
+#else
+    const char sep = '/';
+#endif
+
+    bool has_sep =
+      plen > 0 && (parent[plen - 1] == '/' || parent[plen - 1] == '\\');
+
+    pb->base = plen + (has_sep ? 0 : 1);
+    pb->cap = pb->base + 256;
+    pb->buf = malloc(pb->cap);
+    if (!pb->buf) return false;
+
+    memcpy(pb->buf, parent, plen);
+    if (!has_sep) pb->buf[plen] = sep;
+    pb->buf[pb->base] = '\0';
+    return true;
+}
+
+const char *path_buf_join(path_buf_t *pb, const char *child)
+{
+    size_t clen = strlen(child);
+    if (pb->base + clen + 1 > pb->cap)
+    {
+        size_t cap = pb->base + clen + 1;
+        char *grown = realloc(pb->buf, cap);
+        if (!grown) return NULL;
+        pb->buf = grown;
+        pb->cap = cap;
+    }
+    memcpy(pb->buf + pb->base, child, clen + 1);
+    return pb->buf;
+}
+
+// heap copy of the last joined path, for paths that outlive the buffer
+char *path_buf_copy(const path_buf_t *pb)
+{
+    size_t len = strlen(pb->buf) + 1;
+    char *out = malloc(len);
+    if (out) memcpy(out, pb->buf, len);
+    return out;
+}
+
+void path_buf_free(path_buf_t *pb)
+{
+    free(pb->buf);
+    pb->buf = NULL;
+    pb->cap = 0;
+}
+
+bool path_reader_init(path_reader_t *r, FILE *in)
+{
+    memset(r, 0, sizeof(*r));
+    r->in = in;
+    r->cap = 64 * 1024;
+    r->buf = malloc(r->cap);
+    return r->buf != NULL;
+}
+
+// the returned path stays valid until the next call; NULL at the end
+const char *path_reader_next(path_reader_t *r)
+{
+    for (;;)
+    {
+        char *p = r->buf + r->start;
+        char *nul = memchr(p, '\0', r->end - r->start);
+        if (nul)
+        {
+            r->start = (size_t)(nul - r->buf) + 1;
+            return p;
+        }
+
+        if (r->eof)
+        {
+            if (r->start == r->end) return NULL;
+            // an unterminated last path still counts; the read below
+            // always leaves room for its terminator
+            r->buf[r->end] = '\0';
+            r->start = r->end;
+            return p;
+        }
+
+        // keep the partial path, at the front of a big enough buffer
+        memmove(r->buf, p, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+        if (r->end + 1 >= r->cap)
+        {
+            char *grown = realloc(r->buf, r->cap * 2);
+            if (!grown)
+            {
+                r->failed = true;
+                return NULL;
+            }
+            r->buf = grown;
+            r->cap *= 2;
+        }
+
+        size_t n = fread(r->buf + r->end, 1, r->cap - r->end - 1, r->in);
+        r->end += n;
+        if (n == 0)
+        {
+            r->eof = true;
+            r->failed = ferror(r->in) != 0;
+        }
+    }
+}
+
+void path_reader_free(path_reader_t *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
+
 const char *path_basename(const char *path)
 {
     if (!path || !*path) return "";
@@ -120,7 +254,11 @@ const char *path_basename(const char *path)
     const char *last = path;
     for (const char *p = path; *p; p++)
     {
+#ifdef _WIN32
         if (*p == '/' || *p == '\\')
+#else
+        if (*p == '/') // a backslash is part of a POSIX name
+#endif
         {
             last = p + 1;
         }
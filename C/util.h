@@ -4,10 +4,44 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 bool glob_match(const char *pattern, const char *text);
+bool glob_match_any(char **patterns,
+                    int count,
+                    const char *name,
+                    const char *fullpath);
 char *path_join(const char *parent, const char *child);
+
+// reusable "parent/child" buffer; the parent part is written only once
+typedef struct
+{
+    char *buf;
+    size_t cap;
+    size_t base;
+} path_buf_t;
+
+bool path_buf_init(path_buf_t *pb, const char *parent);
+const char *path_buf_join(path_buf_t *pb, const char *child);
+char *path_buf_copy(const path_buf_t *pb);
+void path_buf_free(path_buf_t *pb);
+// NUL separated paths streamed from a file, as written by find -print0
+typedef struct
+{
+    FILE *in;
+    char *buf; // unread bytes are buf[start, end)
+    size_t start;
+    size_t end;
+    size_t cap;
+    bool eof;
+    bool failed; // a read error or out of memory ended the input early
+} path_reader_t;
+
+bool path_reader_init(path_reader_t *r, FILE *in);
+const char *path_reader_next(path_reader_t *r);
+void path_reader_free(path_reader_t *r);
+
 const char *path_basename(const char *path);
 char *human_size(uint64_t bytes, char *buf, size_t buflen);
 
@@ -0,0 +1,196 @@
+#include "visited.h"
+#include "platform.h"
+#include <stdlib.h>
+
+#define SHARD_COUNT 256 // power of two
+#define SHARD_INITIAL 64
+#define CACHE_LINE 64
+
+typedef struct
+{
+    uint64_t dev;
+    uint64_t ino;
+} visited_key_t;
+
+// padded so neighbouring shards don't share a cache line
+typedef union
+{
+    struct
+    {
+        platform_mutex_t *lock;
+        visited_key_t *keys; // open addressing, ino == 0 marks a free slot
+        size_t capacity;     // power of two
+        size_t count;
+    } s;
+    char pad[CACHE_LINE];
+} visited_shard_t;
+
+struct visited
+{
+    visited_shard_t shards[SHARD_COUNT];
+};
+
+// splitmix64 finalizer; inode numbers are far from uniform
+static uint64_t mix(uint64_t dev, uint64_t ino)
+{
+    uint64_t x = ino ^ (dev * 0x9E3779B97F4A7C15ULL);
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+visited_t *visited_create(void)
+{
+    visited_t *set = calloc(1, sizeof(visited_t));
+    if (!set) return NULL;
+
+    for (int i = 0; i < SHARD_COUNT; i++)
+    {
+        set->shards[i].s.lock = platform_mutex_create();
+        if (!set->shards[i].s.lock)
+        {
+            visited_free(set);
+            return NULL;
+        }
+    }
+    return set;
+}
+
+void visited_free(visited_t *set)
+{
+    if (!set) return;
+    for (int i = 0; i < SHARD_COUNT; i++)
+    {
+        platform_mutex_free(set->shards[i].s.lock);
+        free(set->shards[i].s.keys);
+    }
+    free(set);
+}
+
+// the low hash bits pick the shard, so slots are indexed by the high ones
+static size_t slot_of(uint64_t hash, size_t capacity)
+{
+    return (size_t)(hash >> 8) & (capacity - 1);
+}
+
+static bool shard_grow(visited_shard_t *shard)
+{
+    size_t capacity = shard->s.capacity ? shard->s.capacity * 2
+                                        : SHARD_INITIAL;
+    visited_key_t *keys = calloc(capacity, sizeof(visited_key_t));
+    if (!keys) return false;
+
+    for (size_t i = 0; i < shard->s.capacity; i++)
+    {
+        visited_key_t *k = &shard->s.keys[i];
+        if (k->ino == 0) continue;
+        size_t slot = slot_of(mix(k->dev, k->ino), capacity);
+        while (keys[slot].ino != 0) slot = (slot + 1) & (capacity - 1);
+        keys[slot] = *k;
+    }
+
+    free(shard->s.keys);
+    shard->s.keys = keys;
+    shard->s.capacity = capacity;
+    return true;
+}
+
+// the shard is locked by the caller
+static bool shard_find(visited_shard_t *shard,
+                       uint64_t hash,
+                       uint64_t dev,
+                       uint64_t ino)
+{
+    if (shard->s.count == 0) return false;
+
+    size_t mask = shard->s.capacity - 1;
+    for (size_t slot = slot_of(hash, shard->s.capacity);;
+         slot = (slot + 1) & mask)
+    {
+        visited_key_t *k = &shard->s.keys[slot];
+        if (k->ino == 0) return false;
+        if (k->ino == ino && k->dev == dev) return true;
+    }
+}
+
+// the shard is locked by the caller
+static bool shard_insert(visited_shard_t *shard,
+                         uint64_t hash,
+                         uint64_t dev,
+                         uint64_t ino)
+{
+    // keep the load at or below 1/2
+    if (shard->s.count * 2 >= shard->s.capacity && !shard_grow(shard))
+    {
+        // out of memory: report it as seen, losing a directory rather
+        // than risking a cycle
+        return false;
+    }
+
+    size_t mask = shard->s.capacity - 1;
+    for (size_t slot = slot_of(hash, shard->s.capacity);;
+         slot = (slot + 1) & mask)
+    {
+        visited_key_t *k = &shard->s.keys[slot];
+        if (k->ino == 0)
+        {
+            k->dev = dev;
+            k->ino = ino;
+            shard->s.count++;
+            return true;
+        }
+        if (k->ino == ino && k->dev == dev) return false;
+    }
+}
+
+static visited_shard_t *shard_of(visited_t *set, uint64_t hash)
+{
+    return &set->shards[hash & (SHARD_COUNT - 1)];
+}
+
+bool visited_insert(visited_t *set, uint64_t dev, uint64_t ino)
+{
+    // an unknown identity can't be deduplicated; let it through
+    if (ino == 0) return true;
+
+    uint64_t hash = mix(dev, ino);
+    visited_shard_t *shard = shard_of(set, hash);
+    platform_mutex_lock(shard->s.lock);
+    bool inserted = shard_insert(shard, hash, dev, ino);
+    platform_mutex_unlock(shard->s.lock);
+    return inserted;
+}
+
+bool visited_contains(visited_t *set, uint64_t dev, uint64_t ino)
+{
+    if (ino == 0) return false;
+
+    uint64_t hash = mix(dev, ino);
+    visited_shard_t *shard = shard_of(set, hash);
+    platform_mutex_lock(shard->s.lock);
+    bool found = shard_find(shard, hash, dev, ino);
+    platform_mutex_unlock(shard->s.lock);
+    return found;
+}
+
+bool visited_insert_unless(visited_t *set,
+                           uint64_t dev,
+                           uint64_t ino,
+                           visited_t *other,
+                           uint64_t other_dev,
+                           uint64_t other_ino)
+{
+    if (ino == 0) return true;
+
+    uint64_t hash = mix(dev, ino);
+    visited_shard_t *shard = shard_of(set, hash);
+    platform_mutex_lock(shard->s.lock);
+    // always set's lock, then other's; nothing locks them the other way
+    bool inserted = !visited_contains(other, other_dev, other_ino) &&
+                    shard_insert(shard, hash, dev, ino);
+    platform_mutex_unlock(shard->s.lock);
+    return inserted;
+}
@@ -0,0 +1,30 @@
+#ifndef VISITED_H
+#define VISITED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Concurrent set of (device, inode) pairs, used to reach every directory
+ * only once when symlinks are followed or several roots overlap. Split
+ * into independently locked shards, so workers only wait on each other
+ * when two of them hit the same shard at the same moment.
+ */
+typedef struct visited visited_t;
+
+visited_t *visited_create(void);
+void visited_free(visited_t *set);
+
+// true if the pair was not in the set yet (and now is)
+bool visited_insert(visited_t *set, uint64_t dev, uint64_t ino);
+bool visited_contains(visited_t *set, uint64_t dev, uint64_t ino);
+// inserts (dev, ino) unless (other_dev, other_ino) is in other; the check
+// is made under set's lock, so visited_contains sees both steps or neither
+bool visited_insert_unless(visited_t *set,
+                           uint64_t dev,
+                           uint64_t ino,
+                           visited_t *other,
+                           uint64_t other_dev,
+                           uint64_t other_ino);
+
+#endif
@@ -1,6 +1,11 @@
 #include "walk.h"
+#include "checkpoint.h"
+#include "index.h"
 #include "platform.h"
+#include "progress.h"
+#include "record.h"
 #include "util.h"
+#include "visited.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -8,44 +13,367 @@
     #include <omp.h>
 #endif
 
-#define MAX_SYMLINK_DEPTH 64
+#define CHECKPOINT_INTERVAL 10.0 // seconds
+#define CHECKPOINT_POLL_MS 100
+#define PROGRESS_INTERVAL 0.25 // seconds
+#define PROGRESS_POLL_MS 20
+#define CACHE_LINE 64
+#define CHUNK_ENTRIES 1024
+#define CHUNK_BYTES (64 * 1024)
+#define STREAM_BATCH 1024 // roots per task with --files0-from
+#define STREAM_BATCHES_PER_THREAD 2 // batch tasks queued at most, per thread
+#define MAX_CPUS 4096
 
+#if defined(_MSC_VER)
+    #define ALWAYS_INLINE __forceinline
+#elif defined(__GNUC__)
+    #define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+    #define ALWAYS_INLINE inline
+#endif
+
+typedef struct walk_context walk_context_t;
+
+/*
+ * A directory that is queued or being read. Nodes only exist when the
+ * frontier is tracked (--checkpoint, --time-limit); the node owns its path.
+ */
+typedef struct walk_node
+{
+    char *path;
+    struct walk_node *prev;
+    struct walk_node *next;
+} walk_node_t;
+
+typedef void (*walk_fn_t)(const char *path,
+                          walk_node_t *node,
+                          walk_context_t *ctx);
+
+// contribution of a single directory's own entries
+typedef struct
+{
+    uint64_t size;
+    uint64_t files;
+    uint64_t dirs;
+} walk_totals_t;
+
+typedef struct
+{
+    char **items;
+    size_t count;
+    size_t capacity;
+} path_list_t;
+
+// entries of a big directory handed to another worker to stat
+typedef struct walk_chunk
+{
+    struct walk_chunk *next;
+    char *names; // NUL separated
+    size_t used;
+    size_t count;
+    walk_totals_t totals;
+    path_list_t subdirs; // only when the frontier is tracked
+} walk_chunk_t;
+
+/*
+ * State owned by a single worker, merged once the walk is done. Each
+ * worker allocates (and so first touches) its own, which keeps it on the
+ * worker's NUMA node when threads are pinned.
+ */
 typedef struct
 {
+    ext_table_t *extensions;
+    record_buf_t records;
+    index_buf_t dirs;
+} walk_thread_t;
+
+/*
+ * Live counters of one worker for --progress and --shm. Only the worker
+ * writes its own, so they never see a locked add; padded so workers
+ * don't share a cache line. Totals are added per chunk, not only when a
+ * directory is done, so a huge directory shows up while it's read.
+ */
+typedef union
+{
+    struct
+    {
+        uint64_t queued;   // directories handed out
+        uint64_t finished; // directories done
+        uint64_t busy;     // > 0 while reading a directory or a chunk
+        uint64_t size;
+        uint64_t files;
+        uint64_t dirs;
+    } s;
+    char pad[CACHE_LINE];
+} walk_live_t;
+
+struct walk_context
+{
+    walk_fn_t walk;
     char **excludes;
     int exclude_count;
     bool apparent_size;
     bool verbose;
+    bool by_ext;
+    bool index;
+    bool dereference;
+    visited_t *visited; // with -L or dedupe
+    bool dedupe; // several roots or --files0-from
+    visited_t *root_files; // with dedupe, see root_file_claim
+    sort_key_t sort;
+    walk_thread_t **threads;
+    int thread_count;
+    int *cpu_plan; // CPU per worker when pinning, else NULL
+    walk_live_t *live; // per worker, only with a progress surface
+    progress_t *progress;
+    int setup_failed;
+    // written by all workers; keep off the read-mostly line above
+    char pad[CACHE_LINE];
     uint64_t total_size;
     uint64_t file_count;
     uint64_t dir_count;
-} walk_context_t;
+    uint64_t root_files_listed; // raised before each root_files insert
+    // frontier tracking; totals are then only updated under the mutex
+    bool track;
+    int stopped;
+    double deadline;
+    platform_mutex_t *frontier_lock;
+    walk_node_t frontier; // list sentinel
+    size_t frontier_count;
+    // set while a snapshot reads node paths outside the lock; nodes that
+    // leave the frontier meanwhile are parked here instead of freed
+    bool snapshotting;
+    walk_node_t *retired;
+    const char *checkpoint;
+    uint64_t finished; // read by the helper threads
+};
+
+static inline walk_thread_t *current_thread(walk_context_t *ctx)
+{
+#ifdef _OPENMP
+    return ctx->threads[omp_get_thread_num()];
+#else
+    return ctx->threads[0];
+#endif
+}
 
-static inline bool is_excluded(const char *name,
-                               const char *fullpath,
-                               const walk_context_t *ctx)
+static inline walk_live_t *current_live(walk_context_t *ctx)
 {
-    for (int i = 0; i < ctx->exclude_count; i++)
+#ifdef _OPENMP
+    return &ctx->live[omp_get_thread_num()];
+#else
+    return &ctx->live[0];
+#endif
+}
+
+// the owner is the only writer, so its own read needs no care; the store
+// is atomic for the sampler, which is not an OpenMP thread
+static inline void live_add(uint64_t *counter, uint64_t delta)
+{
+    platform_atomic_store(counter, *counter + delta);
+}
+
+static inline void live_count(walk_live_t *live, const walk_totals_t *t)
+{
+    live_add(&live->s.size, t->size);
+    live_add(&live->s.files, t->files);
+    live_add(&live->s.dirs, t->dirs);
+}
+
+static inline void live_leave(walk_live_t *live)
+{
+    live_add(&live->s.finished, 1);
+    live_add(&live->s.busy, UINT64_MAX);
+}
+
+static bool path_list_push(path_list_t *list, char *path)
+{
+    if (list->count >= list->capacity)
     {
-        if (glob_match(ctx->excludes[i], name) ||
-            glob_match(ctx->excludes[i], fullpath))
-        {
-            return true;
-        }
+        size_t cap = list->capacity ? list->capacity * 2 : 16;
+        char **grown = realloc(list->items, cap * sizeof(char *));
+        if (!grown) return false;
+        list->items = grown;
+        list->capacity = cap;
     }
-    return false;
+    list->items[list->count++] = path;
+    return true;
+}
+
+static walk_chunk_t *chunk_create(void)
+{
+    walk_chunk_t *chunk = calloc(1, sizeof(walk_chunk_t));
+    if (chunk && !(chunk->names = malloc(CHUNK_BYTES)))
+    {
+        free(chunk);
+        chunk = NULL;
+    }
+    return chunk;
+}
+
+// false when the name doesn't fit; the chunk is then left as it was
+static bool chunk_add(walk_chunk_t *chunk, const char *name)
+{
+    size_t len = strlen(name) + 1;
+    if (chunk->used + len > CHUNK_BYTES) return false;
+    memcpy(chunk->names + chunk->used, name, len);
+    chunk->used += len;
+    chunk->count++;
+    return true;
+}
+
+static void chunk_free(walk_chunk_t *chunk)
+{
+    free(chunk->names);
+    free(chunk);
 }
 
-static void process_file(const char *fullpath,
-                         uint64_t size,
-                         walk_context_t *ctx)
+static void totals_add(walk_context_t *ctx, const walk_totals_t *t)
 {
+    // tracked totals change together with the frontier, under its lock
+    if (ctx->track)
+    {
+        platform_mutex_lock(ctx->frontier_lock);
+        ctx->total_size += t->size;
+        ctx->file_count += t->files;
+        ctx->dir_count += t->dirs;
+        platform_mutex_unlock(ctx->frontier_lock);
+        return;
+    }
+
+#pragma omp atomic
+    ctx->total_size += t->size;
 #pragma omp atomic
-    ctx->total_size += size;
+    ctx->file_count += t->files;
 #pragma omp atomic
-    ctx->file_count++;
+    ctx->dir_count += t->dirs;
+}
 
-    if (ctx->verbose)
+static inline void frontier_insert(walk_context_t *ctx, walk_node_t *node)
+{
+    node->prev = &ctx->frontier;
+    node->next = ctx->frontier.next;
+    ctx->frontier.next->prev = node;
+    ctx->frontier.next = node;
+    ctx->frontier_count++;
+}
+
+static inline void frontier_remove(walk_context_t *ctx, walk_node_t *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    ctx->frontier_count--;
+}
+
+static walk_node_t *node_create(char *path)
+{
+    walk_node_t *node = malloc(sizeof(walk_node_t));
+    if (node) node->path = path;
+    return node;
+}
+
+static void node_free(walk_node_t *node)
+{
+    free(node->path);
+    free(node);
+}
+
+/*
+ * Publishes a finished directory: its totals are added, it leaves the
+ * frontier and its subdirectories join it, all in one step. Children are
+ * only spawned afterwards, so a snapshot never sees a subtree counted
+ * twice. Children whose node can't be allocated are dropped (but were
+ * already counted as directories).
+ */
+static void frontier_commit(walk_context_t *ctx,
+                            walk_node_t *node,
+                            const walk_totals_t *t,
+                            path_list_t *subdirs,
+                            walk_fn_t self)
+{
+    walk_node_t **children = NULL;
+    size_t n = 0;
+
+    if (subdirs && subdirs->count)
+    {
+        children = malloc(subdirs->count * sizeof(walk_node_t *));
+        for (size_t i = 0; i < subdirs->count; i++)
+        {
+            walk_node_t *child = children ? node_create(subdirs->items[i])
+                                          : NULL;
+            if (child)
+            {
+                children[n++] = child;
+            }
+            else
+            {
+                free(subdirs->items[i]);
+            }
+        }
+        free(subdirs->items);
+    }
+
+    platform_mutex_lock(ctx->frontier_lock);
+    ctx->total_size += t->size;
+    ctx->file_count += t->files;
+    ctx->dir_count += t->dirs;
+    if (node)
+    {
+        frontier_remove(ctx, node);
+        if (ctx->snapshotting)
+        {
+            node->next = ctx->retired;
+            ctx->retired = node;
+            node = NULL;
+        }
+    }
+    for (size_t i = 0; i < n; i++) frontier_insert(ctx, children[i]);
+    platform_mutex_unlock(ctx->frontier_lock);
+
+    if (node) node_free(node);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        walk_node_t *child = children[i];
+#pragma omp task firstprivate(child, ctx)
+        self(child->path, child, ctx);
+    }
+    free(children);
+}
+
+// once the deadline passes no new directory is opened
+static bool should_stop(walk_context_t *ctx)
+{
+    int stopped;
+#pragma omp atomic read
+    stopped = ctx->stopped;
+
+    if (!stopped && ctx->deadline > 0 && platform_time() >= ctx->deadline)
+    {
+#pragma omp atomic write
+        ctx->stopped = 1;
+        stopped = 1;
+    }
+    return stopped != 0;
+}
+
+static ALWAYS_INLINE void process_file(const char *name,
+                                       const char *fullpath,
+                                       uint64_t size,
+                                       walk_context_t *ctx,
+                                       const bool verbose)
+{
+    if (ctx->by_ext)
+    {
+        ext_table_add(current_thread(ctx)->extensions, name, size);
+    }
+
+    if (verbose && ctx->sort != SORT_NONE)
+    {
+        // on allocation failure the line is lost, the totals are not
+        record_buf_push(&current_thread(ctx)->records, size, fullpath);
+    }
+    else if (verbose)
     {
 #pragma omp critical
         {
@@ -55,129 +383,1285 @@ static void process_file(const char *fullpath,
     }
 }
 
-static void walk_directory_impl(const char *path,
-                                walk_context_t *ctx,
-                                int depth)
+// the directory being read, identified only when a file needs it
+typedef struct
+{
+    const char *path;
+    int known; // 0 not looked up yet, 1 dev and ino are set, -1 failed
+    uint64_t dev;
+    uint64_t ino;
+} walk_dir_id_t;
+
+/*
+ * Root files are keyed by their directory and name rather than their own
+ * inode, so hard links are still counted as often as a single walk counts
+ * them. The name is hashed with FNV-1a; the inode is spread before it is
+ * mixed in, as neighbouring directories have nearly equal inodes.
+ */
+static uint64_t root_file_key(uint64_t dir_ino, const char *name)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (; *name; name++)
+    {
+        h ^= (unsigned char)*name;
+        h *= 0x100000001B3ULL;
+    }
+    h ^= dir_ino * 0x9E3779B97F4A7C15ULL;
+    return h ? h : 1; // 0 is an unknown identity to the set
+}
+
+// a lookup only: most runs with several roots never list a file, and then
+// the directory isn't even identified
+static bool listed_as_root(walk_context_t *ctx,
+                           walk_dir_id_t *dir,
+                           const char *name)
 {
-    // dodge infinite symlink loops
-    if (depth > MAX_SYMLINK_DEPTH)
+    uint64_t listed;
+#pragma omp atomic read
+    listed = ctx->root_files_listed;
+    if (listed == 0) return false;
+
+    if (dir->known == 0)
     {
-        if (ctx->verbose)
+        platform_stat_t st;
+        dir->known = platform_stat(dir->path, &st) ? 1 : -1;
+        dir->dev = dir->known > 0 ? st.dev : 0;
+        dir->ino = dir->known > 0 ? st.ino : 0;
+    }
+    return dir->known > 0 &&
+           visited_contains(
+             ctx->root_files, dir->dev, root_file_key(dir->ino, name));
+}
+
+/*
+ * Stats one directory entry and accounts for it. Subdirectories are
+ * spawned right away, or collected in subdirs when the frontier is
+ * tracked (they are then spawned by frontier_commit).
+ */
+static ALWAYS_INLINE void walk_entry(const char *entry,
+                                     path_buf_t *pb,
+                                     walk_dir_id_t *dir,
+                                     bool tracked,
+                                     walk_context_t *ctx,
+                                     walk_totals_t *totals,
+                                     path_list_t *subdirs,
+                                     walk_fn_t self,
+                                     const bool verbose,
+                                     const bool excludes,
+                                     const bool apparent,
+                                     const bool deref)
+{
+    const char *fullpath = path_buf_join(pb, entry);
+    if (!fullpath) return;
+
+    platform_stat_t st;
+    if (!walk_stat_entry(entry,
+                         fullpath,
+                         ctx->excludes,
+                         excludes ? ctx->exclude_count : 0,
+                         deref,
+                         &st))
+    {
+        return;
+    }
+
+    if (st.is_directory)
+    {
+        // followed links can reach a directory twice, or loop forever, and
+        // a root may be nested in another one
+        // (where lstat can't identify a directory, as on Windows, the id
+        // costs a stat of its own)
+        if (ctx->visited && st.dev == 0 && st.ino == 0)
         {
-            fprintf(
-              stderr, "Warning: max symlink depth reached at '%s'\n", path);
+            platform_stat(fullpath, &st);
+        }
+        if (ctx->visited && !visited_insert(ctx->visited, st.dev, st.ino))
+        {
+            return;
+        }
+
+        char *subdir = path_buf_copy(pb);
+        if (!subdir) return;
+
+        totals->dirs++;
+        if (ctx->live) live_add(&current_live(ctx)->s.queued, 1);
+        if (tracked)
+        {
+            if (!path_list_push(subdirs, subdir)) free(subdir);
+            return;
+        }
+#pragma omp task firstprivate(subdir, ctx, self)
+        {
+            self(subdir, NULL, ctx);
+            free(subdir);
+        }
+    }
+    else
+    {
+        // a file may also have been listed as a root of its own
+        if (ctx->dedupe && listed_as_root(ctx, dir, entry)) return;
+
+        uint64_t size = apparent ? st.size_apparent : st.size_allocated;
+        totals->size += size;
+        totals->files++;
+        process_file(entry, fullpath, size, ctx, verbose);
+    }
+}
+
+// hands a full chunk to another worker, keeping it for the merge
+static ALWAYS_INLINE void chunk_spawn(walk_chunk_t *chunk,
+                                      walk_chunk_t **chunks,
+                                      const char *path,
+                                      bool tracked,
+                                      walk_context_t *ctx,
+                                      walk_fn_t self,
+                                      const bool verbose,
+                                      const bool excludes,
+                                      const bool apparent,
+                                      const bool deref)
+{
+    chunk->next = *chunks;
+    *chunks = chunk;
+
+#pragma omp task firstprivate(chunk, path, tracked, ctx, self)
+    {
+        walk_live_t *live = ctx->live ? current_live(ctx) : NULL;
+        if (live) live_add(&live->s.busy, 1);
+
+        path_buf_t pb;
+        walk_dir_id_t id = { path, 0, 0, 0 };
+        if (path_buf_init(&pb, path))
+        {
+            const char *name = chunk->names;
+            for (size_t i = 0; i < chunk->count; i++)
+            {
+                walk_entry(name,
+                           &pb,
+                           &id,
+                           tracked,
+                           ctx,
+                           &chunk->totals,
+                           &chunk->subdirs,
+                           self,
+                           verbose,
+                           excludes,
+                           apparent,
+                           deref);
+                name += strlen(name) + 1;
+            }
+        }
+        path_buf_free(&pb);
+        // the names are done with; the struct waits to be merged
+        free(chunk->names);
+        chunk->names = NULL;
+        if (live)
+        {
+            live_count(live, &chunk->totals);
+            live_add(&live->s.busy, UINT64_MAX);
         }
-        return;
     }
+}
+
+/*
+ * Body shared by all walker variants. The flags are compile time constants
+ * in every caller (see WALK_VARIANT), so once inlined the per-entry checks
+ * for them fold away; self is the variant itself, used for subdirectories.
+ *
+ * The first CHUNK_ENTRIES entries are handled inline. Past that the
+ * directory is big enough to share: names are gathered into chunks that
+ * other workers stat while this one keeps reading, and their totals and
+ * subdirectories are folded back in before the directory is published.
+ */
+static ALWAYS_INLINE void walk_directory_tmpl(const char *path,
+                                              walk_node_t *node,
+                                              walk_context_t *ctx,
+                                              walk_fn_t self,
+                                              const bool verbose,
+                                              const bool excludes,
+                                              const bool apparent,
+                                              const bool deref)
+{
+    walk_totals_t totals = { 0 };
+    path_list_t subdirs = { 0 };
+
+    // a stopped walk leaves the node in the frontier as unvisited
+    if (node && should_stop(ctx)) return;
 
-    platform_dir_t *dir = platform_opendir(path);
-    if (!dir) return;
+    // tasks are tied, so this stays the running worker's slot
+    walk_live_t *live = ctx->live ? current_live(ctx) : NULL;
+    if (live) live_add(&live->s.busy, 1);
 
+    // files are joined into one buffer per directory; only subdirectory
+    // paths, which outlive this call, get their own allocation
+    path_buf_t pb;
+    platform_dir_t *dir = path_buf_init(&pb, path) ? platform_opendir(path)
+                                                    : NULL;
+    if (!dir)
+    {
+        path_buf_free(&pb);
+        if (node) frontier_commit(ctx, node, &totals, NULL, self);
+        if (live) live_leave(live);
+        return;
+    }
+
+    const bool tracked = node != NULL;
+    walk_dir_id_t id = { path, 0, 0, 0 };
+    walk_chunk_t *chunks = NULL; // handed out, newest first
+    walk_chunk_t *filling = NULL;
+    size_t inline_left = CHUNK_ENTRIES;
     const char *entry;
+
     while ((entry = platform_readdir(dir)) != NULL)
     {
-        char *fullpath = path_join(path, entry);
-        if (!fullpath) continue;
+        if (inline_left > 0)
+        {
+            inline_left--;
+        }
+        else
+        {
+            bool added = filling && chunk_add(filling, entry);
+            if (!added && filling)
+            {
+                // full by size before count
+                chunk_spawn(filling,
+                            &chunks,
+                            path,
+                            tracked,
+                            ctx,
+                            self,
+                            verbose,
+                            excludes,
+                            apparent,
+                            deref);
+                filling = NULL;
+            }
+            if (!added && (filling = chunk_create()) != NULL)
+            {
+                added = chunk_add(filling, entry);
+            }
+            if (added)
+            {
+                if (filling->count == CHUNK_ENTRIES)
+                {
+                    chunk_spawn(filling,
+                                &chunks,
+                                path,
+                                tracked,
+                                ctx,
+                                self,
+                                verbose,
+                                excludes,
+                                apparent,
+                                deref);
+                    filling = NULL;
+                }
+                continue;
+            }
+            // out of memory: stat it here
+        }
+
+        walk_entry(entry,
+                   &pb,
+                   &id,
+                   tracked,
+                   ctx,
+                   &totals,
+                   &subdirs,
+                   self,
+                   verbose,
+                   excludes,
+                   apparent,
+                   deref);
+    }
+
+    platform_closedir(dir);
 
-        if (is_excluded(entry, fullpath, ctx))
+    // the tail that didn't fill a chunk is cheaper to do here
+    if (filling)
+    {
+        const char *name = filling->names;
+        for (size_t i = 0; i < filling->count; i++)
         {
-            free(fullpath);
-            continue;
+            walk_entry(name,
+                       &pb,
+                       &id,
+                       tracked,
+                       ctx,
+                       &totals,
+                       &subdirs,
+                       self,
+                       verbose,
+                       excludes,
+                       apparent,
+                       deref);
+            name += strlen(name) + 1;
         }
+        chunk_free(filling);
+    }
+    path_buf_free(&pb);
+    // chunks count their own share
+    if (live) live_count(live, &totals);
 
-        if (is_symlink(fullpath))
+    if (chunks)
+    {
+        // waiting isn't reading; tasks run meanwhile count themselves
+        if (live) live_add(&live->s.busy, UINT64_MAX);
+#pragma omp taskwait
+        if (live) live_add(&live->s.busy, 1);
+        while (chunks)
         {
-            free(fullpath);
-            continue;
+            walk_chunk_t *chunk = chunks;
+            chunks = chunk->next;
+            totals.size += chunk->totals.size;
+            totals.files += chunk->totals.files;
+            totals.dirs += chunk->totals.dirs;
+            for (size_t i = 0; i < chunk->subdirs.count; i++)
+            {
+                char *subdir = chunk->subdirs.items[i];
+                if (!path_list_push(&subdirs, subdir)) free(subdir);
+            }
+            free(chunk->subdirs.items);
+            chunk_free(chunk);
+        }
+    }
+
+    if (ctx->index)
+    {
+        // a directory missing from the index is only a failed query
+        index_buf_push(&current_thread(ctx)->dirs,
+                       path,
+                       totals.size,
+                       totals.files,
+                       totals.dirs);
+    }
+
+    if (node)
+    {
+        frontier_commit(ctx, node, &totals, &subdirs, self);
+    }
+    else
+    {
+        totals_add(ctx, &totals);
+    }
+    if (live) live_leave(live);
+
+#pragma omp taskwait
+}
+
+#define WALK_VARIANT(NAME, VERBOSE, EXCLUDES, APPARENT, DEREF)              \
+    static void NAME(const char *path, walk_node_t *node, walk_context_t *ctx) \
+    {                                                                          \
+        walk_directory_tmpl(                                                   \
+          path, node, ctx, NAME, VERBOSE, EXCLUDES, APPARENT, DEREF);          \
+    }
+
+// quiet, no excludes, disk usage is the default and most common
+WALK_VARIANT(walk_quiet, false, false, false, false)
+WALK_VARIANT(walk_quiet_deref, false, false, false, true)
+WALK_VARIANT(walk_quiet_apparent, false, false, true, false)
+WALK_VARIANT(walk_quiet_apparent_deref, false, false, true, true)
+WALK_VARIANT(walk_quiet_excludes, false, true, false, false)
+WALK_VARIANT(walk_quiet_excludes_deref, false, true, false, true)
+WALK_VARIANT(walk_quiet_excludes_apparent, false, true, true, false)
+WALK_VARIANT(walk_quiet_excludes_apparent_deref, false, true, true, true)
+WALK_VARIANT(walk_verbose, true, false, false, false)
+WALK_VARIANT(walk_verbose_deref, true, false, false, true)
+WALK_VARIANT(walk_verbose_apparent, true, false, true, false)
+WALK_VARIANT(walk_verbose_apparent_deref, true, false, true, true)
+WALK_VARIANT(walk_verbose_excludes, true, true, false, false)
+WALK_VARIANT(walk_verbose_excludes_deref, true, true, false, true)
+WALK_VARIANT(walk_verbose_excludes_apparent, true, true, true, false)
+WALK_VARIANT(walk_verbose_excludes_apparent_deref, true, true, true, true)
+
+// indexed by verbose << 3 | excludes << 2 | apparent << 1 | dereference
+static const walk_fn_t WALK_VARIANTS[16] = {
+    walk_quiet,
+    walk_quiet_deref,
+    walk_quiet_apparent,
+    walk_quiet_apparent_deref,
+    walk_quiet_excludes,
+    walk_quiet_excludes_deref,
+    walk_quiet_excludes_apparent,
+    walk_quiet_excludes_apparent_deref,
+    walk_verbose,
+    walk_verbose_deref,
+    walk_verbose_apparent,
+    walk_verbose_apparent_deref,
+    walk_verbose_excludes,
+    walk_verbose_excludes_deref,
+    walk_verbose_excludes_apparent,
+    walk_verbose_excludes_apparent_deref,
+};
+
+static walk_fn_t select_walker(const walk_context_t *ctx)
+{
+    unsigned index = (ctx->verbose ? 8u : 0u) |
+                     (ctx->exclude_count > 0 ? 4u : 0u) |
+                     (ctx->apparent_size ? 2u : 0u) |
+                     (ctx->dereference ? 1u : 0u);
+    return WALK_VARIANTS[index];
+}
+
+static void walk_directory(const char *path, walk_context_t *ctx)
+{
+    if (!ctx->track)
+    {
+        ctx->walk(path, NULL, ctx);
+        return;
+    }
+
+    // tracked roots get a node owning a copy of the path
+    size_t len = strlen(path) + 1;
+    char *copy = malloc(len);
+    walk_node_t *node = copy ? node_create(copy) : NULL;
+    if (!node)
+    {
+        free(copy);
+        return;
+    }
+    memcpy(copy, path, len);
+
+    platform_mutex_lock(ctx->frontier_lock);
+    frontier_insert(ctx, node);
+    platform_mutex_unlock(ctx->frontier_lock);
+    ctx->walk(copy, node, ctx);
+}
+
+/*
+ * Only the node pointers and totals are copied under the lock; the paths
+ * are gathered after it is released, so committing workers don't wait
+ * for the copy. Nodes leaving the frontier in the meantime are retired
+ * rather than freed, and released once the copy is done.
+ */
+static bool frontier_snapshot(walk_context_t *ctx, checkpoint_t *cp)
+{
+    memset(cp, 0, sizeof(*cp));
+    cp->apparent_size = ctx->apparent_size;
+    cp->dereference = ctx->dereference;
+
+    platform_mutex_lock(ctx->frontier_lock);
+    size_t count = ctx->frontier_count;
+    walk_node_t **nodes = malloc((count + 1) * sizeof(walk_node_t *));
+    if (nodes)
+    {
+        size_t i = 0;
+        for (walk_node_t *n = ctx->frontier.next; n != &ctx->frontier;
+             n = n->next)
+        {
+            nodes[i++] = n;
+        }
+        ctx->snapshotting = true;
+        cp->total_size = ctx->total_size;
+        cp->file_count = ctx->file_count;
+        cp->dir_count = ctx->dir_count;
+    }
+    platform_mutex_unlock(ctx->frontier_lock);
+    if (!nodes) return false;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) bytes += strlen(nodes[i]->path) + 1;
+
+    cp->pending = malloc((count + 1) * sizeof(char *));
+    cp->storage = malloc(bytes + 1);
+    bool ok = cp->pending && cp->storage;
+    if (ok)
+    {
+        char *p = cp->storage;
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t len = strlen(nodes[i]->path) + 1;
+            memcpy(p, nodes[i]->path, len);
+            cp->pending[i] = p;
+            p += len;
+        }
+        cp->pending_count = count;
+    }
+    free(nodes);
+
+    platform_mutex_lock(ctx->frontier_lock);
+    ctx->snapshotting = false;
+    walk_node_t *retired = ctx->retired;
+    ctx->retired = NULL;
+    platform_mutex_unlock(ctx->frontier_lock);
+    while (retired)
+    {
+        walk_node_t *next = retired->next;
+        node_free(retired);
+        retired = next;
+    }
+
+    if (!ok) checkpoint_free(cp);
+    // set after any free: the patterns are the context's, not the copy's
+    cp->excludes = ctx->excludes;
+    cp->exclude_count = ctx->exclude_count;
+    return ok;
+}
+
+static void write_checkpoint(walk_context_t *ctx)
+{
+    checkpoint_t cp;
+    if (!frontier_snapshot(ctx, &cp) || !checkpoint_save(ctx->checkpoint, &cp))
+    {
+        fprintf(stderr,
+                "Warning: cannot write checkpoint '%s'\n",
+                ctx->checkpoint);
+    }
+    cp.excludes = NULL;
+    checkpoint_free(&cp);
+}
+
+// runs beside the OpenMP team so workers never wait on disk writes
+static void checkpoint_writer(void *arg)
+{
+    walk_context_t *ctx = arg;
+    double next = platform_time() + CHECKPOINT_INTERVAL;
+
+    for (;;)
+    {
+        platform_sleep_ms(CHECKPOINT_POLL_MS);
+
+        if (platform_atomic_load(&ctx->finished)) return;
+
+        if (platform_time() >= next)
+        {
+            write_checkpoint(ctx);
+            next = platform_time() + CHECKPOINT_INTERVAL;
         }
+    }
+}
+
+static void progress_sample(walk_context_t *ctx, progress_counters_t *c)
+{
+    memset(c, 0, sizeof(*c));
+    uint64_t queued = 0;
+    uint64_t finished = 0;
+    for (int i = 0; i < ctx->thread_count; i++)
+    {
+        walk_live_t *live = &ctx->live[i];
+        queued += platform_atomic_load(&live->s.queued);
+        finished += platform_atomic_load(&live->s.finished);
+        if (platform_atomic_load(&live->s.busy)) c->active_workers++;
+        c->bytes += platform_atomic_load(&live->s.size);
+        c->files += platform_atomic_load(&live->s.files);
+        c->dirs += platform_atomic_load(&live->s.dirs);
+    }
+    // slots are read one at a time, so a child may be seen done before
+    // its parent handed it out
+    c->pending_dirs = queued > finished ? queued - finished : 0;
+    c->workers = (uint64_t)ctx->thread_count;
+}
+
+// samples the workers' counters beside the team, like the checkpoint
+// writer; the workers themselves never publish anything
+static void progress_writer(void *arg)
+{
+    walk_context_t *ctx = arg;
+    double next = platform_time() + PROGRESS_INTERVAL;
+
+    for (;;)
+    {
+        platform_sleep_ms(PROGRESS_POLL_MS);
+
+        if (platform_atomic_load(&ctx->finished)) return;
+
+        if (platform_time() >= next)
+        {
+            progress_counters_t c;
+            progress_sample(ctx, &c);
+            progress_update(ctx->progress, &c);
+            next = platform_time() + PROGRESS_INTERVAL;
+        }
+    }
+}
+
+static void collect_unvisited(walk_context_t *ctx, walk_result_t *result)
+{
+    size_t count = 0;
+    for (walk_node_t *n = ctx->frontier.next; n != &ctx->frontier; n = n->next)
+    {
+        count++;
+    }
+
+    result->unvisited = count ? malloc(count * sizeof(char *)) : NULL;
+    while (ctx->frontier.next != &ctx->frontier)
+    {
+        walk_node_t *n = ctx->frontier.next;
+        frontier_remove(ctx, n);
+        if (result->unvisited)
+        {
+            result->unvisited[result->unvisited_count++] = n->path;
+            free(n);
+        }
+        else
+        {
+            node_free(n);
+        }
+    }
+}
+
+static int compare_cpu(const void *a, const void *b)
+{
+    const int *x = a;
+    const int *y = b;
+    if (x[1] != y[1]) return x[1] < y[1] ? -1 : 1;
+    return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+/*
+ * compact: fill one NUMA node before the next, neighbouring workers
+ *          share caches and memory.
+ * spread:  round-robin over nodes, for the most memory bandwidth.
+ */
+static int *affinity_plan(affinity_t mode, int workers)
+{
+    if (mode == AFFINITY_NONE) return NULL;
+
+    int *cpus = malloc(MAX_CPUS * sizeof(int));
+    int *nodes = malloc(MAX_CPUS * sizeof(int));
+    int(*pairs)[2] = malloc(MAX_CPUS * sizeof(*pairs));
+    int *plan = malloc((size_t)workers * sizeof(int));
+    int n = cpus && nodes && pairs && plan
+              ? platform_cpu_topology(cpus, nodes, MAX_CPUS)
+              : 0;
+
+    if (n == 0)
+    {
+        fprintf(stderr, "Warning: thread pinning not supported here\n");
+        free(plan);
+        plan = NULL;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        pairs[i][0] = cpus[i];
+        pairs[i][1] = nodes[i];
+    }
+    if (n) qsort(pairs, (size_t)n, sizeof(*pairs), compare_cpu);
+
+    if (plan && mode == AFFINITY_COMPACT)
+    {
+        for (int w = 0; w < workers; w++) plan[w] = pairs[w % n][0];
+    }
+    else if (plan)
+    {
+        // reuse cpus/nodes as start and size of every node's run in pairs
+        int node_count = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (i == 0 || pairs[i][1] != pairs[i - 1][1])
+            {
+                cpus[node_count++] = i;
+            }
+        }
+        for (int k = 0; k < node_count; k++)
+        {
+            nodes[k] = (k + 1 < node_count ? cpus[k + 1] : n) - cpus[k];
+        }
+        for (int w = 0; w < workers; w++)
+        {
+            int k = w % node_count;
+            plan[w] = pairs[cpus[k] + (w / node_count) % nodes[k]][0];
+        }
+    }
+
+    free(cpus);
+    free(nodes);
+    free(pairs);
+    return plan;
+}
+
+static bool threads_init(walk_context_t *ctx, affinity_t affinity)
+{
+#ifdef _OPENMP
+    ctx->thread_count = omp_get_max_threads();
+#else
+    ctx->thread_count = 1;
+#endif
+    ctx->threads = calloc((size_t)ctx->thread_count, sizeof(walk_thread_t *));
+    if (!ctx->threads) return false;
+
+    ctx->cpu_plan = affinity_plan(affinity, ctx->thread_count);
+    return true;
+}
+
+// run by every worker at the start of the parallel region
+static void thread_setup(walk_context_t *ctx)
+{
+#ifdef _OPENMP
+    int id = omp_get_thread_num();
+#else
+    int id = 0;
+#endif
+
+    // pin first so the allocations below are made on the worker's node
+    if (ctx->cpu_plan) platform_pin_thread(ctx->cpu_plan[id]);
+
+    walk_thread_t *t = calloc(1, sizeof(walk_thread_t));
+    if (t && ctx->by_ext && !(t->extensions = ext_table_create()))
+    {
+        free(t);
+        t = NULL;
+    }
+    if (!t)
+    {
+#pragma omp atomic write
+        ctx->setup_failed = 1;
+    }
+    ctx->threads[id] = t;
+}
+
+static void threads_merge(walk_context_t *ctx, walk_result_t *result)
+{
+    for (int i = 0; i < ctx->thread_count; i++)
+    {
+        walk_thread_t *t = ctx->threads[i];
+        if (t && t->extensions)
+        {
+            if (!result->extensions)
+            {
+                result->extensions = t->extensions;
+                t->extensions = NULL;
+                continue;
+            }
+            ext_table_merge(result->extensions, t->extensions);
+        }
+    }
+
+    if (ctx->index && ctx->thread_count > 0)
+    {
+        index_buf_t *bufs = calloc((size_t)ctx->thread_count, sizeof(*bufs));
+        for (int i = 0; bufs && i < ctx->thread_count; i++)
+        {
+            walk_thread_t *t = ctx->threads[i];
+            if (!t) continue;
+            bufs[i] = t->dirs;
+            memset(&t->dirs, 0, sizeof(t->dirs));
+        }
+        result->index = bufs ? index_build(bufs, ctx->thread_count) : NULL;
+        if (!result->index)
+        {
+            fprintf(stderr, "Error: out of memory while indexing\n");
+        }
+        free(bufs);
+    }
+}
+
+static void threads_free(walk_context_t *ctx)
+{
+    free(ctx->cpu_plan);
+    ctx->cpu_plan = NULL;
+    if (!ctx->threads) return;
+    for (int i = 0; i < ctx->thread_count; i++)
+    {
+        walk_thread_t *t = ctx->threads[i];
+        if (!t) continue;
+        ext_table_free(t->extensions);
+        record_buf_free(&t->records);
+        index_buf_free(&t->dirs);
+        free(t);
+    }
+    free(ctx->threads);
+    ctx->threads = NULL;
+}
+
+typedef struct
+{
+    char *path; // up to and including the last separator
+    bool known;
+    uint64_t dev;
+    uint64_t ino;
+} root_parent_t;
+
+/*
+ * Decides whether a root that isn't a directory is counted here. It is not
+ * if it was listed before, or if its directory was already reached, since
+ * that walk counts it; otherwise it is recorded, and the walk of its
+ * directory skips it when that comes later. A link stands for its target,
+ * which is what a walk would count. Listed files usually come with their
+ * siblings, so the last directory looked up is kept in parent.
+ */
+static bool root_file_claim(walk_context_t *ctx,
+                            const char *path,
+                            bool link,
+                            root_parent_t *parent)
+{
+    if (link)
+    {
+        char *target = platform_realpath(path);
+        if (!target) return true; // can't be matched, so count it
+        bool claimed = root_file_claim(ctx, target, false, parent);
+        free(target);
+        return claimed;
+    }
+
+    const char *name = path_basename(path);
+    size_t len = (size_t)(name - path);
+
+    if (!parent->path || strlen(parent->path) != len ||
+        memcmp(parent->path, path, len) != 0)
+    {
+        char *dir = malloc(len + 1);
+        if (!dir) return true; // can't be matched, so count it
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+        free(parent->path);
+        parent->path = dir;
 
         platform_stat_t st;
-        if (!platform_stat(fullpath, &st))
+        parent->known = platform_stat(len ? dir : ".", &st);
+        parent->dev = parent->known ? st.dev : 0;
+        parent->ino = parent->known ? st.ino : 0;
+    }
+    if (!parent->known) return true;
+
+    // raised before the directory is looked for: a walker that still reads
+    // 0 had entered the directory into visited first, so it is found
+#pragma omp atomic
+    ctx->root_files_listed++;
+    return visited_insert_unless(ctx->root_files,
+                                 parent->dev,
+                                 root_file_key(parent->ino, name),
+                                 ctx->visited,
+                                 parent->dev,
+                                 parent->ino);
+}
+
+// resumed roots come from the checkpoint and were counted before
+static void walk_roots(char **paths,
+                       size_t count,
+                       bool resumed,
+                       walk_context_t *ctx)
+{
+    walk_totals_t totals = { 0 };
+    root_parent_t parent = { NULL, false, 0, 0 };
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *path = paths[i];
+        platform_stat_t st;
+        bool link = false;
+
+        // with dedupe a listed link is matched by its target, so roots are
+        // looked at as links first; a plain file needs nothing more
+        bool found = ctx->dedupe ? platform_lstat(path, &st)
+                                 : platform_stat(path, &st);
+        if (found && ctx->dedupe && (st.is_symlink || st.is_directory))
         {
-            free(fullpath);
+            link = st.is_symlink && !ctx->dereference;
+            found = platform_stat(path, &st);
+        }
+        if (!found)
+        {
+            fprintf(stderr, "Error: cannot stat '%s'\n", path);
             continue;
         }
 
         if (st.is_directory)
         {
-#pragma omp task firstprivate(fullpath, depth) shared(ctx)
+            // a root seen before, or already reached from another root, is
+            // skipped; after --resume the set only knows the pending ones
+            if (ctx->visited && !visited_insert(ctx->visited, st.dev, st.ino))
             {
-                walk_directory_impl(fullpath, ctx, depth + 1);
-                free(fullpath);
+                continue;
             }
-#pragma omp atomic
-            ctx->dir_count++;
+#pragma omp task firstprivate(path, ctx)
+            {
+                walk_directory(path, ctx);
+            }
+            if (!resumed) totals.dirs++;
+            if (ctx->live) live_add(&current_live(ctx)->s.queued, 1);
         }
-        else
+        else if (!ctx->dedupe || root_file_claim(ctx, path, link, &parent))
         {
             uint64_t size =
               ctx->apparent_size ? st.size_apparent : st.size_allocated;
-            process_file(fullpath, size, ctx);
-            free(fullpath);
+            totals.size += size;
+            totals.files++;
+            process_file(path_basename(path), path, size, ctx, ctx->verbose);
+        }
+    }
+
+    free(parent.path);
+    totals_add(ctx, &totals);
+    if (ctx->live) live_count(current_live(ctx), &totals);
+}
+
+typedef struct
+{
+    char **paths;
+    size_t count;
+    char *storage;
+} root_batch_t;
+
+static void batch_free(root_batch_t *batch)
+{
+    free(batch->paths);
+    free(batch->storage);
+    free(batch);
+}
+
+// copies up to STREAM_BATCH paths out of the reader; NULL at the end
+static root_batch_t *batch_read(path_reader_t *reader)
+{
+    root_batch_t *batch = calloc(1, sizeof(root_batch_t));
+    size_t *offsets = malloc(STREAM_BATCH * sizeof(size_t));
+    size_t used = 0;
+    size_t cap = 0;
+    const char *path = NULL;
+
+    if (!batch || !offsets) reader->failed = true;
+    while (batch && offsets && !reader->failed &&
+           batch->count < STREAM_BATCH &&
+           (path = path_reader_next(reader)) != NULL)
+    {
+        size_t len = strlen(path) + 1;
+        if (used + len > cap)
+        {
+            size_t grown_cap = cap ? cap * 2 : 16 * 1024;
+            while (grown_cap < used + len) grown_cap *= 2;
+            char *grown = realloc(batch->storage, grown_cap);
+            if (!grown)
+            {
+                reader->failed = true;
+                break;
+            }
+            batch->storage = grown;
+            cap = grown_cap;
         }
+        memcpy(batch->storage + used, path, len);
+        offsets[batch->count++] = used;
+        used += len;
     }
 
+    if (batch && batch->count)
+    {
+        batch->paths = malloc(batch->count * sizeof(char *));
+        for (size_t i = 0; batch->paths && i < batch->count; i++)
+        {
+            batch->paths[i] = batch->storage + offsets[i];
+        }
+    }
+    free(offsets);
+
+    if (batch && (!batch->count || !batch->paths))
+    {
+        if (batch->count) fprintf(stderr, "Error: out of memory\n");
+        batch_free(batch);
+        batch = NULL;
+    }
+    return batch;
+}
+
+/*
+ * Feeds --files0-from input to the team a batch at a time, so the list is
+ * never held in full. Each batch is a task that walks its roots and frees
+ * them once their directories are done, while this thread reads on. When
+ * the team is behind, with the cap of batches queued, this thread walks
+ * the next batch itself (an undeferred task) rather than read further.
+ */
+static void walk_stream(path_reader_t *reader, walk_context_t *ctx)
+{
+    const uint64_t cap =
+      (uint64_t)ctx->thread_count * STREAM_BATCHES_PER_THREAD;
+    uint64_t queued = 0;
+    root_batch_t *batch;
+    while ((batch = batch_read(reader)) != NULL)
+    {
+        uint64_t now;
+#pragma omp atomic read
+        now = queued;
+        bool defer = now < cap;
+        if (defer)
+        {
+#pragma omp atomic
+            queued++;
+        }
+#pragma omp task firstprivate(batch, ctx, defer) shared(queued) if (defer)
+        {
+            walk_roots(batch->paths, batch->count, false, ctx);
+#pragma omp taskwait
+            batch_free(batch);
+            if (defer)
+            {
+#pragma omp atomic
+                queued--;
+            }
+        }
+    }
+    // the batches count down on this frame
 #pragma omp taskwait
-    platform_closedir(dir);
 }
 
-static void walk_directory(const char *path, walk_context_t *ctx)
+static void reader_close(path_reader_t *reader)
+{
+    if (reader->in && reader->in != stdin) fclose(reader->in);
+    path_reader_free(reader);
+}
+
+void walk_result_free(walk_result_t *result)
 {
-    walk_directory_impl(path, ctx, 0);
+    ext_table_free(result->extensions);
+    index_free(result->index);
+    for (size_t i = 0; i < result->unvisited_count; i++)
+    {
+        free(result->unvisited[i]);
+    }
+    free(result->unvisited);
+    memset(result, 0, sizeof(*result));
+}
+
+// the patterns must match in order, as that is how they were given
+static bool same_excludes(const checkpoint_t *cp, const args_t *args)
+{
+    if (cp->exclude_count != args->exclude_count) return false;
+    for (int i = 0; i < cp->exclude_count; i++)
+    {
+        if (strcmp(cp->excludes[i], args->excludes[i]) != 0) return false;
+    }
+    return true;
 }
 
-walk_result_t walk_paths(char **paths,
-                         int path_count,
-                         char **excludes,
-                         int exclude_count,
-                         bool apparent_size,
-                         bool verbose,
-                         bool quiet)
+walk_result_t walk_paths(const args_t *args)
 {
-    walk_context_t ctx = { .excludes = excludes,
-                           .exclude_count = exclude_count,
-                           .apparent_size = apparent_size,
-                           .verbose = verbose,
+    walk_context_t ctx = { .walk = NULL,
+                           .excludes = args->excludes,
+                           .exclude_count = args->exclude_count,
+                           .apparent_size = args->apparent_size,
+                           .verbose = args->verbose,
+                           .by_ext = args->by_ext,
+                           .index = args->index,
+                           .dereference = args->dereference,
+                           .visited = NULL,
+                           .dedupe = args->files0_from ||
+                                     args->path_count > 1,
+                           .root_files = NULL,
+                           .sort = args->sort,
+                           .threads = NULL,
+                           .thread_count = 0,
+                           .cpu_plan = NULL,
+                           .live = NULL,
+                           .progress = NULL,
+                           .setup_failed = 0,
                            .total_size = 0,
                            .file_count = 0,
-                           .dir_count = 0 };
+                           .dir_count = 0,
+                           .root_files_listed = 0,
+                           .track = args->checkpoint || args->time_limit > 0,
+                           .stopped = 0,
+                           .deadline = 0,
+                           .frontier_lock = NULL,
+                           .frontier_count = 0,
+                           .snapshotting = false,
+                           .retired = NULL,
+                           .checkpoint = args->checkpoint,
+                           .finished = 0 };
+
+    walk_result_t result = { 0 };
+    checkpoint_t resume = { 0 };
+    ctx.walk = select_walker(&ctx);
+    ctx.frontier.next = ctx.frontier.prev = &ctx.frontier;
+
+    path_reader_t reader = { 0 };
+    if (args->files0_from)
+    {
+        bool from_stdin = strcmp(args->files0_from, "-") == 0;
+        FILE *in = from_stdin ? stdin : fopen(args->files0_from, "rb");
+        if (!in || !path_reader_init(&reader, in))
+        {
+            fprintf(stderr, "Error: cannot read '%s'\n", args->files0_from);
+            if (in && !from_stdin) fclose(in);
+            result.failed = true;
+            return result;
+        }
+    }
+
+    if (args->resume)
+    {
+        if (!checkpoint_load(args->checkpoint, &resume))
+        {
+            fprintf(stderr,
+                    "Error: cannot read checkpoint '%s'\n",
+                    args->checkpoint);
+            reader_close(&reader);
+            result.failed = true;
+            return result;
+        }
+        const char *mismatch = NULL;
+        if (resume.apparent_size != args->apparent_size)
+        {
+            mismatch = "--apparent-size";
+        }
+        else if (resume.dereference != args->dereference)
+        {
+            mismatch = "-L";
+        }
+        else if (!same_excludes(&resume, args))
+        {
+            mismatch = "--exclude";
+        }
+        if (mismatch)
+        {
+            fprintf(stderr,
+                    "Error: checkpoint '%s' was taken with different %s\n",
+                    args->checkpoint,
+                    mismatch);
+            checkpoint_free(&resume);
+            reader_close(&reader);
+            result.failed = true;
+            return result;
+        }
+        ctx.total_size = resume.total_size;
+        ctx.file_count = resume.file_count;
+        ctx.dir_count = resume.dir_count;
+    }
+
+    if ((ctx.track && !(ctx.frontier_lock = platform_mutex_create())) ||
+        ((ctx.dereference || ctx.dedupe) &&
+         !(ctx.visited = visited_create())) ||
+        (ctx.dedupe && !(ctx.root_files = visited_create())))
+    {
+        fprintf(stderr, "Error: out of memory\n");
+        platform_mutex_free(ctx.frontier_lock);
+        visited_free(ctx.visited);
+        visited_free(ctx.root_files);
+        checkpoint_free(&resume);
+        reader_close(&reader);
+        result.failed = true;
+        return result;
+    }
+
+    if (!threads_init(&ctx, args->affinity))
+    {
+        fprintf(stderr, "Error: out of memory\n");
+        threads_free(&ctx);
+        platform_mutex_free(ctx.frontier_lock);
+        visited_free(ctx.visited);
+        visited_free(ctx.root_files);
+        checkpoint_free(&resume);
+        reader_close(&reader);
+        result.failed = true;
+        return result;
+    }
+
+    if (args->time_limit > 0)
+    {
+        ctx.deadline = platform_time() + (double)args->time_limit;
+    }
+
+    platform_thread_t *writer = NULL;
+    if (ctx.checkpoint)
+    {
+        writer = platform_thread_start(checkpoint_writer, &ctx);
+        if (!writer)
+        {
+            fprintf(stderr, "Warning: no background checkpoint writer\n");
+        }
+    }
+
+    platform_thread_t *sampler = NULL;
+    if (args->progress > 0 || args->shm)
+    {
+        ctx.live = calloc((size_t)ctx.thread_count, sizeof(walk_live_t));
+        if (ctx.live)
+        {
+            // a resumed walk starts from the checkpoint's totals
+            walk_totals_t base = { ctx.total_size,
+                                   ctx.file_count,
+                                   ctx.dir_count };
+            live_count(&ctx.live[0], &base);
+        }
+        ctx.progress = ctx.live ? progress_start(args->shm, args->progress)
+                                : NULL;
+        sampler = ctx.progress ? platform_thread_start(progress_writer, &ctx)
+                               : NULL;
+        if (!sampler)
+        {
+            fprintf(stderr, "Warning: no progress reporting\n");
+            progress_stop(ctx.progress);
+            ctx.progress = NULL;
+            free(ctx.live);
+            ctx.live = NULL;
+        }
+    }
 
 #pragma omp parallel
     {
+        thread_setup(&ctx);
+#pragma omp barrier
 #pragma omp single nowait
         {
-            for (int i = 0; i < path_count; i++)
+            if (ctx.setup_failed)
+            {
+                fprintf(stderr, "Error: out of memory\n");
+            }
+            else if (args->resume)
+            {
+                walk_roots(resume.pending, resume.pending_count, true, &ctx);
+            }
+            else if (args->files0_from)
+            {
+                walk_stream(&reader, &ctx);
+            }
+            else
             {
-                const char *path = paths[i];
-                platform_stat_t st;
+                walk_roots(
+                  args->paths, (size_t)args->path_count, false, &ctx);
+            }
+        }
+    }
 
-                if (!platform_stat(path, &st))
-                {
-                    fprintf(stderr, "Error: cannot stat '%s'\n", path);
-                    continue;
-                }
+    if (writer || sampler)
+    {
+        platform_atomic_store(&ctx.finished, 1);
+        platform_thread_join(writer);
+        platform_thread_join(sampler);
+    }
+    // the final state always lands on disk, complete or not
+    if (ctx.checkpoint) write_checkpoint(&ctx);
 
-                if (st.is_directory)
-                {
-#pragma omp task firstprivate(path) shared(ctx)
-                    {
-                        walk_directory(path, &ctx);
-                    }
-#pragma omp atomic
-                    ctx.dir_count++;
-                }
-                else
-                {
-                    uint64_t size =
-                      apparent_size ? st.size_apparent : st.size_allocated;
-                    process_file(path, size, &ctx);
-                }
-            }
+    if (ctx.progress)
+    {
+        progress_counters_t c;
+        progress_sample(&ctx, &c);
+        c.finished = 1;
+        progress_update(ctx.progress, &c);
+        progress_stop(ctx.progress);
+        free(ctx.live);
+    }
+
+    if (ctx.verbose && ctx.sort != SORT_NONE)
+    {
+        record_buf_t *bufs = calloc((size_t)ctx.thread_count, sizeof(*bufs));
+        for (int i = 0; bufs && i < ctx.thread_count; i++)
+        {
+            if (ctx.threads[i]) bufs[i] = ctx.threads[i]->records;
         }
+        if (!bufs || !records_print_sorted(bufs, ctx.thread_count, ctx.sort))
+        {
+            fprintf(stderr, "Error: out of memory while sorting output\n");
+        }
+        free(bufs);
     }
 
-    walk_result_t result = { .total_size = ctx.total_size,
-                             .file_count = ctx.file_count,
-                             .dir_count = ctx.dir_count };
+    result.total_size = ctx.total_size;
+    result.file_count = ctx.file_count;
+    result.dir_count = ctx.dir_count;
+    result.partial = ctx.stopped != 0;
+    result.failed = ctx.setup_failed != 0;
+    if (reader.failed)
+    {
+        fprintf(stderr,
+                "Error: cannot read all of '%s'\n",
+                args->files0_from);
+        result.failed = true;
+    }
+    collect_unvisited(&ctx, &result);
+    threads_merge(&ctx, &result);
+    threads_free(&ctx);
+    platform_mutex_free(ctx.frontier_lock);
+    visited_free(ctx.visited);
+    visited_free(ctx.root_files);
+    checkpoint_free(&resume);
+    reader_close(&reader);
     return result;
 }
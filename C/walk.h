@@ -1,7 +1,13 @@
 #ifndef WALK_H
 #define WALK_H
 
+#include "args.h"
+#include "ext.h"
+#include "index.h"
+#include "platform.h"
+#include "util.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct
@@ -9,14 +15,40 @@ typedef struct
     uint64_t total_size;
     uint64_t file_count;
     uint64_t dir_count;
+    ext_table_t *extensions; // only with --by-ext
+    dir_index_t *index;      // only with args->index
+    bool partial;            // stopped by --time-limit
+    bool failed;             // an error was reported; the totals are void
+    char **unvisited;        // directories left out of the totals
+    size_t unvisited_count;
 } walk_result_t;
 
-walk_result_t walk_paths(char **paths,
-                         int path_count,
-                         char **excludes,
-                         int exclude_count,
-                         bool apparent_size,
-                         bool verbose,
-                         bool quiet);
+/*
+ * How the walker sees one directory entry, shared with the estimator so
+ * both count the same things: false when it is excluded, can't be stat'ed
+ * or is a symlink that isn't followed.
+ */
+static inline bool walk_stat_entry(const char *name,
+                                   const char *fullpath,
+                                   char **excludes,
+                                   int exclude_count,
+                                   bool deref,
+                                   platform_stat_t *st)
+{
+    if (exclude_count > 0 &&
+        glob_match_any(excludes, exclude_count, name, fullpath))
+    {
+        return false;
+    }
+    // one call either way: lstat reports links so they can be skipped
+    if (!(deref ? platform_stat(fullpath, st) : platform_lstat(fullpath, st)))
+    {
+        return false;
+    }
+    return !st->is_symlink;
+}
+
+walk_result_t walk_paths(const args_t *args);
+void walk_result_free(walk_result_t *result);
 
 #endif